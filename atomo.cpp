@@ -2,19 +2,58 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <vector>
 #include <cmath>
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <array>
+#include <sstream>
+#include <fstream>
+#include <cctype>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <filesystem>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// Câmera e modos: só a thread de render escreve (os callbacks do GLFW passam pela inputQueue)
 float cameraDistance = 20.0f; // distância da câmera ao centro
+float maxCameraDistance = 20.0f; // limite do zoom, ajustado ao tamanho da cena
 float yaw = -90.0f;   // Ângulo de rotação horizontal (em graus)
 float pitch = 0.0f;   // Ângulo de rotação vertical
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 bool mousePressed = false;
+bool sphereImpostors = false; // esferas como impostores em vez de malhas (tecla I alterna)
+unsigned int orbitalSelection = 0; // nuvem mostrada, entre as de --orbital (tecla O avança)
+bool playbackPaused = false; // reprodução de --trajetoria parada (tecla espaço)
+int playbackSeek = 0;        // passos pedidos pelas setas: segundos tocando, quadros parado
 
 
 // Posição da luz
@@ -27,17 +66,58 @@ const char* vertexShaderSource = R"glsl(
     
     out vec3 FragPos;
     out vec3 Normal;
+    out vec3 Color;
+    
+    // Dados de câmera e luz do frame, compartilhados por todos os shaders (binding 0)
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
     
     uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    uniform vec3 objectColor;
     
     void main() {
         FragPos = vec3(model * vec4(aPos, 1.0));
         Normal = mat3(transpose(inverse(model))) * aNormal;
+        Color = objectColor;
         gl_Position = projection * view * model * vec4(aPos, 1.0);
     }
     )glsl";
+
+    // Mesmo shader, mas com a matriz de modelo e a cor vindas de um buffer de instâncias
+    const char* instancedVertexShaderSource = R"glsl(
+    #version 330 core
+    layout(location = 0) in vec3 aPos;
+    layout(location = 1) in vec3 aNormal;
+    layout(location = 2) in mat4 aInstanceModel; // ocupa as locations 2 a 5
+    layout(location = 6) in vec3 aInstanceColor;
+    
+    out vec3 FragPos;
+    out vec3 Normal;
+    out vec3 Color;
+    
+    // Dados de câmera e luz do frame, compartilhados por todos os shaders (binding 0)
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
+    
+    void main() {
+        FragPos = vec3(aInstanceModel * vec4(aPos, 1.0));
+        Normal = mat3(transpose(inverse(aInstanceModel))) * aNormal;
+        Color = aInstanceColor;
+        gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
+    }
+    )glsl";
     
     const char* fragmentShaderSource = R"glsl(
     #version 330 core
@@ -45,41 +125,331 @@ const char* vertexShaderSource = R"glsl(
     
     in vec3 FragPos;
     in vec3 Normal;
+    in vec3 Color;
     
-    uniform vec3 objectColor;
-    uniform vec3 lightColor;
-    uniform vec3 lightPos;
-    uniform vec3 viewPos;
+    // Dados de câmera e luz do frame, compartilhados por todos os shaders (binding 0)
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
+    
+    void main() {
+        // Ambient
+        float ambientStrength = 0.1;
+        vec3 ambient = ambientStrength * lightColor.rgb;
+        
+        // Diffuse 
+        vec3 norm = normalize(Normal);
+        vec3 lightDir = normalize(lightPos.xyz - FragPos);
+        float diff = max(dot(norm, lightDir), 0.0);
+        vec3 diffuse = diff * lightColor.rgb;
+        
+        // Specular
+        float specularStrength = 0.5;
+        vec3 viewDir = normalize(viewPos.xyz - FragPos);
+        vec3 reflectDir = reflect(-lightDir, norm);  
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+        vec3 specular = specularStrength * spec * lightColor.rgb;
+            
+        vec3 result = (ambient + diffuse + specular) * Color;
+        FragColor = vec4(result, 1.0);
+    }
+    )glsl";
+
+    // Órbitas procedurais: os pontos do anel saem de gl_VertexID; raio, plano, elipse e precessão
+    // de cada órbita vêm do buffer de instâncias. Nenhum vertex buffer por órbita.
+    const char* orbitVertexShaderSource = R"glsl(
+    #version 330 core
+    layout(location = 0) in vec4 aCenterRadius; // xyz = centro, w = semi-eixo maior
+    layout(location = 1) in vec4 aOrientation;  // quaternion do plano (a órbita base está em XZ)
+    layout(location = 2) in vec4 aShape;        // x = semi-eixo menor, y = precessão (rad/s), z = fase da precessão
+    layout(location = 3) in vec4 aColor;
+    
+    out vec3 Color;
+    
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
+    
+    uniform int segments;
+    
+    vec3 rotateByQuat(vec4 q, vec3 v) {
+        return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+    }
+    
+    void main() {
+        float angle = 6.28318530718 * float(gl_VertexID) / float(segments);
+        vec3 p = rotateByQuat(aOrientation, vec3(aCenterRadius.w * cos(angle), 0.0, aShape.x * sin(angle)));
+        // Precessão: o plano da órbita gira em torno do eixo Y do átomo
+        float precession = aShape.y * time + aShape.z;
+        float c = cos(precession), s = sin(precession);
+        p = vec3(c * p.x + s * p.z, p.y, -s * p.x + c * p.z);
+        Color = aColor.rgb;
+        gl_Position = projection * view * vec4(aCenterRadius.xyz + p, 1.0);
+    }
+    )glsl";
+
+    const char* orbitFragmentShaderSource = R"glsl(
+    #version 330 core
+    out vec4 FragColor;
+    in vec3 Color;
+    
+    void main() {
+        FragColor = vec4(Color, 1.0);
+    }
+    )glsl";
+
+    // Esferas como impostores: um quadrado voltado para a câmera por instância (4 vértices de gl_VertexID,
+    // sem vertex buffer de malha) e a interseção raio-esfera no fragment shader. As instâncias são as mesmas
+    // das esferas em malha: centro na translação da matriz, raio na escala (a malha é a esfera unitária).
+    const char* impostorVertexShaderSource = R"glsl(
+    #version 330 core
+    layout(location = 2) in mat4 aInstanceModel; // ocupa as locations 2 a 5
+    layout(location = 6) in vec3 aInstanceColor;
+    
+    out vec3 QuadPos;
+    flat out vec4 Sphere; // xyz = centro, w = raio
+    flat out vec3 Color;
+    
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
+    
+    void main() {
+        vec3 center = aInstanceModel[3].xyz;
+        float radius = length(aInstanceModel[0].xyz);
+        // O quadrado fica no plano do centro, perpendicular à linha de visão, do tamanho do cone que
+        // tangencia a esfera a partir do olho; com o olho dentro da esfera ele some
+        vec3 toCenter = center - viewPos.xyz;
+        float eyeDistance = length(toCenter);
+        vec3 axis = toCenter / eyeDistance;
+        vec3 right = normalize(cross(axis, abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+        vec3 up = cross(right, axis);
+        float halfSize = eyeDistance > radius ? radius * eyeDistance / sqrt(eyeDistance * eyeDistance - radius * radius) : 0.0;
+        vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+        QuadPos = center + (corner.x * right + corner.y * up) * halfSize;
+        Sphere = vec4(center, radius);
+        Color = aInstanceColor;
+        gl_Position = projection * view * vec4(QuadPos, 1.0);
+    }
+    )glsl";
+
+    // Mesma iluminação Phong do fragmentShaderSource, com posição, normal e profundidade do ponto atingido
+    const char* impostorFragmentShaderSource = R"glsl(
+    #version 330 core
+    #extension GL_ARB_conservative_depth : enable
+    out vec4 FragColor;
+    
+    in vec3 QuadPos;
+    flat in vec4 Sphere;
+    flat in vec3 Color;
+    
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
+    
+    #ifdef GL_ARB_conservative_depth
+    // A superfície está sempre à frente do quadrado, o que preserva parte do teste de profundidade antecipado
+    layout(depth_less) out float gl_FragDepth;
+    #endif
     
     void main() {
+        vec3 rayDir = normalize(QuadPos - viewPos.xyz);
+        vec3 toCenter = Sphere.xyz - viewPos.xyz;
+        float b = dot(rayDir, toCenter);
+        float discriminant = b * b - dot(toCenter, toCenter) + Sphere.w * Sphere.w;
+        if (discriminant < 0.0) discard;
+        vec3 FragPos = viewPos.xyz + rayDir * (b - sqrt(discriminant));
+        vec3 Normal = (FragPos - Sphere.xyz) / Sphere.w;
+        vec4 clipPos = projection * view * vec4(FragPos, 1.0);
+        gl_FragDepth = 0.5 * clipPos.z / clipPos.w + 0.5;
+        
         // Ambient
         float ambientStrength = 0.1;
-        vec3 ambient = ambientStrength * lightColor;
+        vec3 ambient = ambientStrength * lightColor.rgb;
         
         // Diffuse 
         vec3 norm = normalize(Normal);
-        vec3 lightDir = normalize(lightPos - FragPos);
+        vec3 lightDir = normalize(lightPos.xyz - FragPos);
         float diff = max(dot(norm, lightDir), 0.0);
-        vec3 diffuse = diff * lightColor;
+        vec3 diffuse = diff * lightColor.rgb;
         
         // Specular
         float specularStrength = 0.5;
-        vec3 viewDir = normalize(viewPos - FragPos);
+        vec3 viewDir = normalize(viewPos.xyz - FragPos);
         vec3 reflectDir = reflect(-lightDir, norm);  
         float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-        vec3 specular = specularStrength * spec * lightColor;
+        vec3 specular = specularStrength * spec * lightColor.rgb;
             
-        vec3 result = (ambient + diffuse + specular) * objectColor;
+        vec3 result = (ambient + diffuse + specular) * Color;
         FragColor = vec4(result, 1.0);
     }
     )glsl";
 
-    void generateSphere(std::vector<float>& vertices, std::vector<unsigned int>& indices, std::vector<float>& normals, unsigned int sectorCount, unsigned int stackCount) {
+    // Reprodução de trajetória: a posição vem do quadro gravado (int16 por eixo, como está no arquivo) e
+    // o raio e a cor de um buffer fixo. Sem a rotação das esferas, que não muda a imagem.
+    const char* trajectoryVertexShaderSource = R"glsl(
+    #version 330 core
+    layout(location = 0) in vec3 aPos;
+    layout(location = 1) in vec3 aNormal;
+    layout(location = 2) in vec3 aQuantizedPos;
+    layout(location = 3) in float aInstanceScale;
+    layout(location = 6) in vec3 aInstanceColor;
+    
+    out vec3 FragPos;
+    out vec3 Normal;
+    out vec3 Color;
+    
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
+    
+    uniform vec4 quantization; // xyz = centro do cubo da gravação, w = passo da quantização
+    
+    void main() {
+        FragPos = quantization.xyz + quantization.w * aQuantizedPos + aInstanceScale * aPos;
+        Normal = aNormal;
+        Color = aInstanceColor;
+        gl_Position = projection * view * vec4(FragPos, 1.0);
+    }
+    )glsl";
+
+    // O mesmo quadrado do impostorVertexShaderSource, com as instâncias da trajetória
+    const char* trajectoryImpostorVertexShaderSource = R"glsl(
+    #version 330 core
+    layout(location = 2) in vec3 aQuantizedPos;
+    layout(location = 3) in float aInstanceScale;
+    layout(location = 6) in vec3 aInstanceColor;
+    
+    out vec3 QuadPos;
+    flat out vec4 Sphere; // xyz = centro, w = raio
+    flat out vec3 Color;
+    
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
+    
+    uniform vec4 quantization;
+    
+    void main() {
+        vec3 center = quantization.xyz + quantization.w * aQuantizedPos;
+        float radius = aInstanceScale;
+        vec3 toCenter = center - viewPos.xyz;
+        float eyeDistance = length(toCenter);
+        vec3 axis = toCenter / eyeDistance;
+        vec3 right = normalize(cross(axis, abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+        vec3 up = cross(right, axis);
+        float halfSize = eyeDistance > radius ? radius * eyeDistance / sqrt(eyeDistance * eyeDistance - radius * radius) : 0.0;
+        vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+        QuadPos = center + (corner.x * right + corner.y * up) * halfSize;
+        Sphere = vec4(center, radius);
+        Color = aInstanceColor;
+        gl_Position = projection * view * vec4(QuadPos, 1.0);
+    }
+    )glsl";
+
+    // Nuvem de probabilidade: um ponto por amostra, desenhado como sprite redondo com mistura aditiva
+    const char* cloudVertexShaderSource = R"glsl(
+    #version 330 core
+    layout(location = 0) in vec4 aPoint; // xyz = posição, w = sinal da função de onda
+    
+    out vec3 Color;
+    
+    layout(std140) uniform FrameData {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPos;
+        vec4 lightPos;
+        vec4 lightColor;
+        float time;
+    };
+    
+    uniform float pointScale; // tamanho do ponto em pixels a uma unidade de distância
+    uniform float intensity;
+    
+    void main() {
+        vec4 eyePos = view * vec4(aPoint.xyz, 1.0);
+        gl_Position = projection * eyePos;
+        gl_PointSize = clamp(pointScale / -eyePos.z, 1.0, 6.0);
+        // Lobos positivos em azul, negativos em laranja (as cores dos elétrons)
+        Color = (aPoint.w > 0.0 ? vec3(0.25, 0.5, 1.0) : vec3(1.0, 0.6, 0.0)) * intensity;
+    }
+    )glsl";
+
+    const char* cloudFragmentShaderSource = R"glsl(
+    #version 330 core
+    out vec4 FragColor;
+    in vec3 Color;
+    
+    void main() {
+        vec2 p = gl_PointCoord * 2.0 - 1.0;
+        float r2 = dot(p, p);
+        if (r2 > 1.0) discard;
+        FragColor = vec4(Color * (1.0 - r2), 1.0);
+    }
+    )glsl";
+
+// Vértice intercalado de 16 bytes: posição em float e normal compactada em 10:10:10:2 com sinal
+struct Vertex {
+    glm::vec3 position;
+    uint32_t normal;
+};
+static_assert(sizeof(Vertex) == 16, "Vertex deve ter 16 bytes");
+
+// Compacta uma componente em 10 bits com sinal (arredondando para longe do zero, como lround)
+constexpr uint32_t packSnorm10(float v) {
+    float clamped = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    int i = int(clamped * 511.0f + (clamped >= 0.0f ? 0.5f : -0.5f));
+    return uint32_t(i) & 0x3FFu;
+}
+
+// Compacta uma normal unitária no formato GL_INT_2_10_10_10_REV (normalizado)
+constexpr uint32_t packNormal(float x, float y, float z) {
+    return packSnorm10(x) | (packSnorm10(y) << 10) | (packSnorm10(z) << 20);
+}
+
+uint32_t packNormal(const glm::vec3& n) {
+    return packNormal(n.x, n.y, n.z);
+}
+
+void generateSphere(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int sectorCount, unsigned int stackCount) {
     float x, y, z, xy;
     float sectorStep = 2 * M_PI / sectorCount;
     float stackStep = M_PI / stackCount;
     float sectorAngle, stackAngle;
 
+    vertices.reserve(vertices.size() + (stackCount + 1) * (sectorCount + 1));
+    indices.reserve(indices.size() + (stackCount - 1) * sectorCount * 6);
+
     for (unsigned int i = 0; i <= stackCount; ++i) {
         stackAngle = M_PI / 2 - i * stackStep;
         xy = cos(stackAngle);
@@ -89,14 +459,8 @@ const char* vertexShaderSource = R"glsl(
             sectorAngle = j * sectorStep;
             x = xy * cos(sectorAngle);
             y = xy * sin(sectorAngle);
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
-
-            // Normals (same as vertex positions for a unit sphere)
-            normals.push_back(x);
-            normals.push_back(y);
-            normals.push_back(z);
+            // Numa esfera unitária a normal é a própria posição
+            vertices.push_back({ glm::vec3(x, y, z), packNormal(glm::vec3(x, y, z)) });
         }
     }
 
@@ -119,341 +483,5180 @@ const char* vertexShaderSource = R"glsl(
     }
 }
 
-unsigned int createShaderProgram() {
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
+// Icosfera: icosaedro subdividido e projetado na esfera unitária.
+// Triângulos bem mais uniformes que a esfera UV (menos vértices para o mesmo contorno).
+void generateIcosphere(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int subdivisions) {
+    const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    std::vector<glm::vec3> positions = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1},
+    };
+    std::vector<unsigned int> faces = {
+        0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+        1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+        3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+        4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1,
+    };
+    for (glm::vec3& p : positions) p = glm::normalize(p);
+
+    for (unsigned int level = 0; level < subdivisions; ++level) {
+        // Cada aresta ganha um ponto médio, compartilhado pelos dois triângulos vizinhos
+        std::unordered_map<uint64_t, unsigned int> midpoints;
+        midpoints.reserve(faces.size());
+        auto midpoint = [&](unsigned int a, unsigned int b) {
+            uint64_t edge = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+            auto found = midpoints.find(edge);
+            if (found != midpoints.end()) return found->second;
+            positions.push_back(glm::normalize((positions[a] + positions[b]) * 0.5f));
+            unsigned int index = (unsigned int)positions.size() - 1;
+            midpoints.emplace(edge, index);
+            return index;
+        };
+        std::vector<unsigned int> subdivided;
+        subdivided.reserve(faces.size() * 4);
+        for (size_t f = 0; f < faces.size(); f += 3) {
+            unsigned int a = faces[f], b = faces[f + 1], c = faces[f + 2];
+            unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            unsigned int tris[] = { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca };
+            subdivided.insert(subdivided.end(), tris, tris + 12);
+        }
+        faces.swap(subdivided);
+    }
+
+    unsigned int base = (unsigned int)vertices.size();
+    vertices.reserve(vertices.size() + positions.size());
+    for (const glm::vec3& p : positions)
+        vertices.push_back({ p, packNormal(p) });
+    indices.reserve(indices.size() + faces.size());
+    for (unsigned int i : faces)
+        indices.push_back(base + i);
+}
+
+// ---- Tabelas de malha montadas em tempo de compilação ----
+// Ficam em memória somente leitura: nada de sin/cos nem alocação na inicialização.
+
+constexpr double PI_DOUBLE = 3.14159265358979323846;
+
+// Seno avaliável em constexpr: redução para [-pi, pi] e série de Taylor (erro < 1e-13)
+constexpr double constexprSin(double x) {
+    while (x > PI_DOUBLE) x -= 2.0 * PI_DOUBLE;
+    while (x < -PI_DOUBLE) x += 2.0 * PI_DOUBLE;
+    double term = x, sum = x;
+    for (int n = 1; n < 14; ++n) {
+        term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double constexprCos(double x) {
+    return constexprSin(x + PI_DOUBLE / 2.0);
+}
+
+// Mesmo layout de Vertex, mas só com tipos literais para poder ser montado em constexpr
+struct MeshVertex {
+    float x, y, z;
+    uint32_t normal;
+};
+static_assert(sizeof(MeshVertex) == sizeof(Vertex), "MeshVertex precisa ter o layout de Vertex");
+
+// Linhas de latitude por faixa na ordem dos triângulos: percorrer a esfera em faixas, coluna a coluna,
+// mantém as duas colunas de vértices da faixa (2 * 7) num cache FIFO de 16 entradas
+const unsigned int SPHERE_BAND_ROWS = 6;
+
+// Esfera UV com os mesmos vértices e triângulos de generateSphere, já em ordem amigável ao cache
+template <unsigned int Sectors, unsigned int Stacks>
+struct SphereMesh {
+    static_assert(Sectors >= 3 && Stacks >= 2, "resolucao de esfera pequena demais");
+    static constexpr size_t VERTEX_COUNT = (Stacks + 1) * (Sectors + 1);
+    static constexpr size_t INDEX_COUNT = (Stacks - 1) * Sectors * 6;
+    static_assert(VERTEX_COUNT <= 65536, "a tabela usa indices de 16 bits");
+
+    std::array<MeshVertex, VERTEX_COUNT> vertices{};
+    std::array<uint16_t, INDEX_COUNT> indices{};
+
+    constexpr SphereMesh() {
+        const double sectorStep = 2.0 * PI_DOUBLE / Sectors;
+        const double stackStep = PI_DOUBLE / Stacks;
+        size_t v = 0;
+        for (unsigned int i = 0; i <= Stacks; ++i) {
+            double stackAngle = PI_DOUBLE / 2.0 - i * stackStep;
+            double xy = constexprCos(stackAngle);
+            float z = float(constexprSin(stackAngle));
+            for (unsigned int j = 0; j <= Sectors; ++j) {
+                double sectorAngle = j * sectorStep;
+                float x = float(xy * constexprCos(sectorAngle));
+                float y = float(xy * constexprSin(sectorAngle));
+                vertices[v++] = { x, y, z, packNormal(x, y, z) };
+            }
+        }
+
+        size_t n = 0;
+        for (unsigned int band = 0; band < Stacks; band += SPHERE_BAND_ROWS) {
+            unsigned int bandEnd = band + SPHERE_BAND_ROWS < Stacks ? band + SPHERE_BAND_ROWS : Stacks;
+            for (unsigned int j = 0; j < Sectors; ++j) {
+                for (unsigned int i = band; i < bandEnd; ++i) {
+                    uint16_t k1 = uint16_t(i * (Sectors + 1) + j);
+                    uint16_t k2 = uint16_t(k1 + Sectors + 1);
+                    if (i != 0) {
+                        indices[n++] = k1;
+                        indices[n++] = k2;
+                        indices[n++] = uint16_t(k1 + 1);
+                    }
+                    if (i != Stacks - 1) {
+                        indices[n++] = uint16_t(k1 + 1);
+                        indices[n++] = k2;
+                        indices[n++] = uint16_t(k2 + 1);
+                    }
+                }
+            }
+        }
+    }
+};
+
+// Níveis de detalhe pré-calculados
+constexpr SphereMesh<40, 40> SPHERE_LOD0{};
+constexpr SphereMesh<20, 20> SPHERE_LOD1{};
+constexpr SphereMesh<10, 10> SPHERE_LOD2{};
+
+static_assert(SPHERE_LOD0.INDEX_COUNT == 9360, "40x40 deve ter 3120 triangulos");
+static_assert(SPHERE_LOD0.vertices[0].z > 0.99999f && SPHERE_LOD0.vertices[SPHERE_LOD0.VERTEX_COUNT - 1].z < -0.99999f,
+              "o primeiro e o ultimo anel devem estar nos polos");
+
+// Confere uma tabela constexpr contra generateSphere com a mesma resolução.
+// Devolve a maior diferença de posição, ou -1 se normais ou triângulos não baterem
+// (os triângulos são comparados como conjunto, pois a ordem é diferente).
+template <unsigned int Sectors, unsigned int Stacks>
+float compareWithRuntimeSphere(const SphereMesh<Sectors, Stacks>& mesh) {
+    std::vector<Vertex> runtimeVertices;
+    std::vector<unsigned int> runtimeIndices;
+    generateSphere(runtimeVertices, runtimeIndices, Sectors, Stacks);
+    if (runtimeVertices.size() != mesh.vertices.size() || runtimeIndices.size() != mesh.indices.size())
+        return -1.0f;
+
+    float maxError = 0.0f;
+    for (size_t i = 0; i < runtimeVertices.size(); ++i) {
+        const MeshVertex& v = mesh.vertices[i];
+        glm::vec3 delta = runtimeVertices[i].position - glm::vec3(v.x, v.y, v.z);
+        maxError = std::max(maxError, std::max(std::abs(delta.x), std::max(std::abs(delta.y), std::abs(delta.z))));
+        // A normal compactada pode diferir em 1 unidade quando a componente cai perto de um meio-passo
+        for (int c = 0; c < 3; ++c) {
+            int a = int((runtimeVertices[i].normal >> (10 * c)) & 0x3FF), b = int((v.normal >> (10 * c)) & 0x3FF);
+            int diff = std::abs(a - b);
+            if (diff > 1 && diff != 0x3FF) return -1.0f;
+        }
+    }
+
+    // Cada triângulo girado para começar pelo menor índice (preserva a orientação)
+    auto triangles = [](const auto& indices) {
+        std::vector<std::array<unsigned int, 3>> tris;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            std::array<unsigned int, 3> tri = { indices[t], indices[t + 1], indices[t + 2] };
+            std::rotate(tri.begin(), std::min_element(tri.begin(), tri.end()), tri.end());
+            tris.push_back(tri);
+        }
+        std::sort(tris.begin(), tris.end());
+        return tris;
+    };
+    if (triangles(runtimeIndices) != triangles(mesh.indices)) return -1.0f;
+    return maxError;
+}
+
+// --teste-esferas: confere os três níveis de detalhe constexpr contra generateSphere. Sai com 1 se
+// normais ou triângulos não baterem, ou se alguma posição diferir mais que a tolerância.
+int runSphereTest() {
+    const float tolerance = 1e-6f; // as duas versões calculam em double e arredondam para float
+    struct Result {
+        const char* name;
+        float error;
+    };
+    const Result results[] = {
+        { "40x40", compareWithRuntimeSphere(SPHERE_LOD0) },
+        { "20x20", compareWithRuntimeSphere(SPHERE_LOD1) },
+        { "10x10", compareWithRuntimeSphere(SPHERE_LOD2) },
+    };
+    bool ok = true;
+    for (const Result& result : results) {
+        bool pass = result.error >= 0.0f && result.error <= tolerance;
+        ok = ok && pass;
+        std::cout << "esfera UV " << result.name << ": ";
+        if (result.error < 0.0f) std::cout << "normais ou triangulos diferentes";
+        else std::cout << "maior erro de posicao " << result.error << " (tolerancia " << tolerance << ")";
+        std::cout << (pass ? " - ok" : " - FALHOU") << std::endl;
+    }
+    std::cout << (ok ? "Tabelas constexpr iguais a generateSphere" : "Tabelas constexpr DIFERENTES de generateSphere") << std::endl;
+    return ok ? 0 : 1;
+}
+
+// ---- Programas de shader: cache de binários em disco e compilação em paralelo ----
+
+// Hash FNV-1a de 64 bits, encadeável (hash de um trecho vira a semente do próximo)
+uint64_t fnv1a64(const char* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Log de compilação de um shader ou de link de um programa
+std::string shaderInfoLog(unsigned int object, bool isProgram) {
+    GLint length = 0;
+    if (isProgram) glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    else glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    std::string log(std::max(length, 1), '\0');
+    if (isProgram) glGetProgramInfoLog(object, (GLsizei)log.size(), nullptr, &log[0]);
+    else glGetShaderInfoLog(object, (GLsizei)log.size(), nullptr, &log[0]);
+    log.resize(std::strlen(log.c_str()));
+    return log;
+}
 
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
-    glCompileShader(fragmentShader);
+unsigned int compileShader(GLenum type, const char* source) {
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    return shader;
+}
 
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+// Cabeçalho de um arquivo do cache, seguido do binário devolvido por glGetProgramBinary
+const char PROGRAM_CACHE_MAGIC[8] = { 'A', 'T', 'O', 'M', 'O', 'P', 'R', 'G' };
+const uint32_t PROGRAM_CACHE_VERSION = 1;
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+struct ProgramCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t format; // GLenum do binário
+    uint64_t key;
+    uint64_t length;
+};
 
-    return shaderProgram;
+// Diretório padrão do cache: %LOCALAPPDATA%\atomo\shaders, $XDG_CACHE_HOME/atomo/shaders ou ~/.cache/atomo/shaders
+std::string defaultShaderCacheDirectory() {
+#ifdef _WIN32
+    const char* base = std::getenv("LOCALAPPDATA");
+    return base && *base ? std::string(base) + "\\atomo\\shaders" : std::string();
+#else
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) return std::string(xdg) + "/atomo/shaders";
+    const char* home = std::getenv("HOME");
+    return home && *home ? std::string(home) + "/.cache/atomo/shaders" : std::string();
+#endif
 }
 
-void generateOrbitXZ(std::vector<float>& orbitVertices, float radius, int segments = 100) {
-    for (int i = 0; i <= segments; ++i) {
-        float angle = 2.0f * M_PI * i / segments;
-        orbitVertices.push_back(radius * cos(angle));  // X
-        orbitVertices.push_back(0.0f);                 // Y
-        orbitVertices.push_back(radius * sin(angle));  // Z
+// Programas por par de fontes. prefetch() dispara a compilação e volta na hora: com GL_KHR_parallel_shader_compile
+// o driver compila em threads próprias enquanto o programa faz outra coisa, e get() só espera o que faltar.
+// Programas ligados vão para o disco (glGetProgramBinary), com a chave formada pelo driver (fabricante, GPU e
+// versão) e pelo texto dos dois shaders; na próxima execução glProgramBinary pula a compilação. Um binário que
+// o driver recusar (driver atualizado) é recompilado e regravado.
+class ProgramCache {
+public:
+    // Com o contexto atual. Diretório vazio (ou driver sem formatos de binário) = sem cache em disco.
+    void init(const std::string& cacheDirectory) {
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+            const char* value = (const char*)glGetString(name);
+            driver += value ? value : "";
+            driver += '\n';
+        }
+        if (GLEW_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        parallel = GLEW_KHR_parallel_shader_compile;
+        GLint formats = 0;
+        if (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats > 0 && !cacheDirectory.empty()) {
+            std::error_code error;
+            std::filesystem::create_directories(cacheDirectory, error);
+            if (!error) directory = cacheDirectory;
+        }
+    }
+
+    // Começa a preparar o programa sem esperar por ele
+    void prefetch(const char* vertexSource, const char* fragmentSource) { start(vertexSource, fragmentSource); }
+
+    // Nenhum programa pedido está compilando (sem a extensão, não há como saber sem esperar: responde true)
+    bool idle() const {
+        if (!parallel) return true;
+        for (const auto& entry : entries) {
+            GLint done = GL_TRUE;
+            if (entry.second.pending) glGetProgramiv(entry.second.program, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done) return false;
+        }
+        return true;
+    }
+
+    // Programa pronto, esperando a compilação se preciso. 0 se a compilação ou o link falharem (o log vai para std::cerr).
+    unsigned int get(const char* vertexSource, const char* fragmentSource) {
+        Entry& entry = start(vertexSource, fragmentSource);
+        if (entry.pending) finish(entry);
+        return entry.program;
+    }
+
+    // Termina todos os programas pedidos. false se algum falhou (os erros já foram mostrados).
+    bool finishAll() {
+        for (auto& entry : entries)
+            if (entry.second.pending) finish(entry.second);
+        return failed == 0;
+    }
+
+    bool diskEnabled() const { return !directory.empty(); }
+
+    void report(std::ostream& out) const {
+        char text[320];
+        std::snprintf(text, sizeof(text), "shaders: %u do cache em disco, %u compilados (%u gravados, %u binarios recusados), "
+                      "%.1f ms pedindo, %.1f ms esperando; compilacao paralela %s; cache ",
+                      fromDisk, compiled, stored, rejected, issueMilliseconds, waitMilliseconds, parallel ? "sim" : "indisponivel");
+        out << text << (diskEnabled() ? directory : std::string("desligado")) << std::endl;
+    }
+
+    unsigned int fromDisk = 0, compiled = 0, stored = 0, rejected = 0, failed = 0;
+    bool parallel = false;
+    double issueMilliseconds = 0.0; // pedindo compilações e carregando binários
+    double waitMilliseconds = 0.0;  // parado em get() esperando o driver
+
+private:
+    struct Entry {
+        uint64_t key = 0;
+        unsigned int program = 0;
+        unsigned int shaders[2] = {};
+        bool pending = false; // compilação pedida, resultado ainda não conferido
+    };
+
+    Entry& start(const char* vertexSource, const char* fragmentSource) {
+        uint64_t key = fnv1a64(driver.data(), driver.size());
+        key = fnv1a64(vertexSource, std::strlen(vertexSource) + 1, key);
+        key = fnv1a64(fragmentSource, std::strlen(fragmentSource) + 1, key);
+        auto found = entries.find(key);
+        if (found != entries.end()) return found->second;
+
+        auto begin = std::chrono::steady_clock::now();
+        Entry& entry = entries[key];
+        entry.key = key;
+        if (!loadBinary(entry)) {
+            entry.shaders[0] = compileShader(GL_VERTEX_SHADER, vertexSource);
+            entry.shaders[1] = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+            entry.program = glCreateProgram();
+            glAttachShader(entry.program, entry.shaders[0]);
+            glAttachShader(entry.program, entry.shaders[1]);
+            if (diskEnabled()) glProgramParameteri(entry.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            glLinkProgram(entry.program);
+            entry.pending = true;
+        }
+        issueMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return entry;
+    }
+
+    // Confere a compilação e o link (bloqueia até o driver terminar), mostra os erros e grava o binário
+    void finish(Entry& entry) {
+        auto begin = std::chrono::steady_clock::now();
+        GLint linked = GL_FALSE;
+        glGetProgramiv(entry.program, GL_LINK_STATUS, &linked);
+        waitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        if (linked) {
+            ++compiled;
+            if (diskEnabled()) storeBinary(entry);
+        } else {
+            const char* stages[2] = { "vertex shader", "fragment shader" };
+            for (int s = 0; s < 2; ++s) {
+                GLint ok = GL_FALSE;
+                glGetShaderiv(entry.shaders[s], GL_COMPILE_STATUS, &ok);
+                if (!ok) std::cerr << "Erro ao compilar o " << stages[s] << ":\n" << shaderInfoLog(entry.shaders[s], false) << std::endl;
+            }
+            std::cerr << "Erro ao ligar o programa de shader:\n" << shaderInfoLog(entry.program, true) << std::endl;
+            glDeleteProgram(entry.program);
+            entry.program = 0;
+            ++failed;
+        }
+        for (unsigned int& shader : entry.shaders) {
+            if (entry.program) glDetachShader(entry.program, shader);
+            glDeleteShader(shader);
+            shader = 0;
+        }
+        entry.pending = false;
+    }
+
+    std::string pathFor(uint64_t key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    bool loadBinary(Entry& entry) {
+        if (!diskEnabled()) return false;
+        std::ifstream file(pathFor(entry.key), std::ios::binary);
+        ProgramCacheHeader header;
+        if (!file.read((char*)&header, sizeof(header))) return false;
+        if (std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != PROGRAM_CACHE_VERSION ||
+            header.key != entry.key || header.length == 0 || header.length > (64u << 20))
+            return false;
+        std::vector<char> binary((size_t)header.length);
+        if (!file.read(binary.data(), (std::streamsize)binary.size())) return false;
+        entry.program = glCreateProgram();
+        glProgramBinary(entry.program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(entry.program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(entry.program);
+            entry.program = 0;
+            ++rejected;
+            return false;
+        }
+        ++fromDisk;
+        return true;
+    }
+
+    // Grava num arquivo temporário e renomeia, para uma execução simultânea nunca ler um binário pela metade.
+    // O temporário leva o pid: dois processos gravando a mesma chave não escrevem no mesmo arquivo
+    void storeBinary(const Entry& entry) {
+        GLint length = 0;
+        glGetProgramiv(entry.program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        std::vector<char> binary((size_t)length);
+        GLenum format = 0;
+        glGetProgramBinary(entry.program, length, &length, &format, binary.data());
+        ProgramCacheHeader header;
+        std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+        header.version = PROGRAM_CACHE_VERSION;
+        header.format = format;
+        header.key = entry.key;
+        header.length = (uint64_t)length;
+#ifdef _WIN32
+        unsigned long processId = GetCurrentProcessId();
+#else
+        unsigned long processId = (unsigned long)getpid();
+#endif
+        std::string path = pathFor(entry.key), temporary = path + "." + std::to_string(processId) + ".tmp";
+        bool written;
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            written = file.write((const char*)&header, sizeof(header)) && file.write(binary.data(), length) && file.flush();
+        }
+        std::error_code error;
+        if (written) std::filesystem::rename(temporary, path, error);
+        if (written && !error) ++stored;
+        else std::filesystem::remove(temporary, error);
     }
+
+    std::string driver;
+    std::string directory;
+    std::unordered_map<uint64_t, Entry> entries;
+};
+
+// Todos os programas passam por aqui (iniciado logo depois de criar o contexto)
+ProgramCache programCache;
+
+// Tempo até o primeiro quadro, contado do início do processo (inicialização estática)
+const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+
+double millisecondsSinceStart() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processStart).count();
 }
 
-void generateOrbitYZ(std::vector<float>& orbitVertices, float radius, int segments = 100) {
-    for (int i = 0; i <= segments; ++i) {
-        float angle = 2.0f * M_PI * i / segments;
-        orbitVertices.push_back(0.0f);                 // X
-        orbitVertices.push_back(radius * cos(angle));  // Y
-        orbitVertices.push_back(radius * sin(angle));  // Z
+// Marcos da inicialização, em ms desde o início do processo
+struct StartupTimes {
+    double context = 0.0;         // contexto GL criado
+    double firstFrame = 0.0;      // primeiro quadro na tela (de carregamento, se a cena ainda não estava pronta)
+    double sceneReady = 0.0;      // cena, malhas e programas prontos
+    double firstSceneFrame = 0.0; // primeiro quadro com a cena
+
+    void report(std::ostream& out) const {
+        char text[200];
+        std::snprintf(text, sizeof(text), "Inicio: contexto em %.1f ms, primeiro quadro em %.1f ms, cena pronta em %.1f ms, "
+                      "primeiro quadro da cena em %.1f ms", context, firstFrame, sceneReady, firstSceneFrame);
+        out << text << std::endl;
     }
+};
+
+// Programa de shader com as locations dos uniforms resolvidas uma única vez, logo após o link
+struct ShaderProgram {
+    unsigned int id = 0;
+    GLint model = -1;
+    GLint objectColor = -1;
+};
+
+// Ponto de ligação do uniform block FrameData
+const unsigned int FRAME_DATA_BINDING = 0;
+
+ShaderProgram loadShaderProgram(const char* vertexSource, const char* fragmentSource) {
+    ShaderProgram program;
+    program.id = programCache.get(vertexSource, fragmentSource);
+    if (!program.id) return program;
+    program.model = glGetUniformLocation(program.id, "model");
+    program.objectColor = glGetUniformLocation(program.id, "objectColor");
+    unsigned int frameBlock = glGetUniformBlockIndex(program.id, "FrameData");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program.id, frameBlock, FRAME_DATA_BINDING);
+    return program;
+}
+
+// Espelho em C++ do bloco std140 FrameData (mat4 e vec4 já têm o alinhamento de 16 bytes do std140)
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPos;
+    glm::vec4 lightPos;
+    glm::vec4 lightColor;
+    float time;
+    float padding[3]; // std140 arredonda o bloco para múltiplo de 16 bytes
+};
+static_assert(sizeof(FrameUniforms) == 192, "FrameUniforms precisa seguir o layout std140");
+
+FrameUniforms makeFrameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos, float time) {
+    FrameUniforms frame = {};
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPos = glm::vec4(cameraPos, 1.0f);
+    frame.lightPos = glm::vec4(cameraPos, 1.0f); // luz acompanha a câmera
+    frame.lightColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    frame.time = time;
+    return frame;
 }
 
-void generateOrbitDiagonal(std::vector<float>& orbitVertices, float radius, int segments = 100) {
-    for (int i = 0; i <= segments; ++i) {
-        float angle = 2.0f * M_PI * i / segments;
-        float x = radius * cos(angle);
-        float z = radius * sin(angle);
-        orbitVertices.push_back(x);       // X
-        orbitVertices.push_back(0.0f);    // Y
-        orbitVertices.push_back(z);       // Z
+// Atualiza o uniform buffer do frame (uma única transferência para todos os programas)
+void updateFrameUniforms(unsigned int frameUBO, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos,
+                         float time) {
+    FrameUniforms frame = makeFrameUniforms(view, projection, cameraPos, time);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), &frame, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameUBO);
+}
+
+// Tamanho do cache de vértices pós-transformação usado na otimização e nas estatísticas
+const unsigned int VERTEX_CACHE_SIZE = 32;
+
+// Reordena os triângulos para reaproveitar o cache de vértices pós-transformação
+// (algoritmo linear de Tom Forsyth, com cache LRU simulado)
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    const int cacheSize = (int)VERTEX_CACHE_SIZE;
+
+    // Lista de triângulos de cada vértice (os ainda não emitidos ficam no início da lista)
+    std::vector<unsigned int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+    for (unsigned int v : indices) ++remaining[v];
+    for (size_t v = 0; v < vertexCount; ++v) offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size()), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+        for (int k = 0; k < 3; ++k) adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount), triangleScore(triangleCount, 0.0f);
+    std::vector<bool> emitted(triangleCount, false);
+    auto score = [&](unsigned int v) {
+        if (remaining[v] == 0) return -1.0f;
+        float s = 0.0f;
+        int position = cachePosition[v];
+        if (position >= 0)
+            s = position < 3 ? 0.75f : std::pow(1.0f - float(position - 3) / float(cacheSize - 3), 1.5f);
+        return s + 2.0f / std::sqrt((float)remaining[v]); // vértices com poucos triângulos restantes primeiro
+    };
+    for (size_t v = 0; v < vertexCount; ++v) vertexScore[v] = score((unsigned int)v);
+    for (size_t t = 0; t < triangleCount; ++t)
+        for (int k = 0; k < 3; ++k) triangleScore[t] += vertexScore[indices[t * 3 + k]];
+
+    std::vector<unsigned int> output, cache, newCache;
+    output.reserve(indices.size());
+    size_t scanCursor = 0;
+    long best = 0;
+    for (size_t t = 1; t < triangleCount; ++t)
+        if (triangleScore[t] > triangleScore[best]) best = (long)t;
+
+    while (output.size() < indices.size()) {
+        if (best < 0) {
+            // Nenhum candidato no cache: pega o próximo triângulo ainda não emitido
+            while (emitted[scanCursor]) ++scanCursor;
+            best = (long)scanCursor;
+        }
+        const unsigned int* tri = &indices[best * 3];
+        emitted[best] = true;
+        newCache.assign(tri, tri + 3);
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = tri[k];
+            output.push_back(v);
+            // Remove o triângulo da lista do vértice
+            unsigned int* list = &adjacency[offsets[v]];
+            for (unsigned int i = 0; i < remaining[v]; ++i) {
+                if (list[i] == (unsigned int)best) {
+                    std::swap(list[i], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+        for (unsigned int v : cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2]) newCache.push_back(v);
+
+        // Reavalia os vértices afetados (inclusive os que saíram do cache) e escolhe o melhor triângulo vizinho
+        best = -1;
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < newCache.size(); ++i) {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < (size_t)cacheSize ? (int)i : -1;
+            float updated = score(v);
+            float delta = updated - vertexScore[v];
+            vertexScore[v] = updated;
+            for (unsigned int j = 0; j < remaining[v]; ++j) {
+                unsigned int t = adjacency[offsets[v] + j];
+                triangleScore[t] += delta;
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = (long)t;
+                }
+            }
+        }
+        if (newCache.size() > (size_t)cacheSize) newCache.resize(cacheSize);
+        cache.swap(newCache);
     }
+    indices.swap(output);
 }
 
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-    cameraDistance -= (float)yoffset * 0.5f;
-    if (cameraDistance < 1.0f) cameraDistance = 1.0f;
-    if (cameraDistance > 20.0f) cameraDistance = 20.0f;
+// Renumera os vértices na ordem de primeiro uso, para leitura sequencial do vertex buffer
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    std::vector<unsigned int> remap(vertices.size(), ~0u);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (unsigned int& i : indices) {
+        if (remap[i] == ~0u) {
+            remap[i] = (unsigned int)reordered.size();
+            reordered.push_back(vertices[i]);
+        }
+        i = remap[i];
+    }
+    vertices.swap(reordered); // vértices não referenciados são descartados
 }
 
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
-    if (button == GLFW_MOUSE_BUTTON_LEFT) {
-        if (action == GLFW_PRESS)
-            mousePressed = true;
-        else if (action == GLFW_RELEASE)
-            mousePressed = false;
+// ACMR: vértices transformados por triângulo; ATVR: vértices transformados por vértice único (ideal = 1)
+struct VertexCacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+// Simula um cache FIFO de VERTEX_CACHE_SIZE entradas, como o de boa parte do hardware
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount) {
+    std::vector<unsigned int> fifo(VERTEX_CACHE_SIZE, ~0u);
+    size_t head = 0, misses = 0;
+    for (unsigned int v : indices) {
+        if (std::find(fifo.begin(), fifo.end(), v) != fifo.end()) continue;
+        fifo[head] = v;
+        head = (head + 1) % VERTEX_CACHE_SIZE;
+        ++misses;
     }
+    VertexCacheStats stats;
+    if (!indices.empty()) stats.acmr = float(misses) / (indices.size() / 3);
+    if (vertexCount) stats.atvr = float(misses) / vertexCount;
+    return stats;
 }
 
-void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
-    if (!mousePressed) {
-        firstMouse = true;
-        return;
+// Endereço de uma malha dentro do GeometryPool
+struct MeshHandle {
+    GLenum mode = GL_TRIANGLES;
+    GLsizei count = 0;       // índices, ou vértices quando a malha não é indexada
+    GLenum indexType = 0;    // GL_UNSIGNED_SHORT, GL_UNSIGNED_INT ou 0 (sem índices)
+    size_t indexOffset = 0;  // em bytes, no buffer de índices
+    GLint baseVertex = 0;
+};
+
+// Todas as malhas num único vertex buffer intercalado e num único index buffer, com um só VAO
+class GeometryPool {
+public:
+    // Malha de triângulos: reordenada para o cache de vértices, com índices de 16 bits quando cabem
+    MeshHandle addTriangles(const char* name, std::vector<Vertex> meshVertices, std::vector<unsigned int> meshIndices) {
+        MeshReport report;
+        report.name = name;
+        report.before = analyzeVertexCache(meshIndices, meshVertices.size());
+        optimizeVertexCache(meshIndices, meshVertices.size());
+        optimizeVertexFetch(meshVertices, meshIndices);
+        report.after = analyzeVertexCache(meshIndices, meshVertices.size());
+        report.vertices = meshVertices.size();
+        report.triangles = meshIndices.size() / 3;
+
+        MeshHandle mesh;
+        mesh.mode = GL_TRIANGLES;
+        mesh.count = (GLsizei)meshIndices.size();
+        mesh.baseVertex = (GLint)vertices.size();
+        if (meshVertices.size() <= 65536) {
+            mesh.indexType = GL_UNSIGNED_SHORT;
+            mesh.indexOffset = appendIndices<uint16_t>(meshIndices);
+        } else {
+            mesh.indexType = GL_UNSIGNED_INT;
+            mesh.indexOffset = appendIndices<uint32_t>(meshIndices);
+        }
+        report.indexBytes = meshIndices.size() * (mesh.indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+        reports.push_back(report);
+
+        vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+        return mesh;
+    }
+
+    // Malha de uma tabela constexpr: já vem em ordem para o cache e com índices de 16 bits, só é copiada
+    template <size_t VertexCount, size_t IndexCount>
+    MeshHandle addPrebuiltTriangles(const char* name, const std::array<MeshVertex, VertexCount>& meshVertices,
+                                    const std::array<uint16_t, IndexCount>& meshIndices) {
+        MeshReport report;
+        report.name = name;
+        report.vertices = VertexCount;
+        report.triangles = IndexCount / 3;
+        report.indexBytes = IndexCount * sizeof(uint16_t);
+        report.prebuilt = true;
+        report.after = analyzeVertexCache(std::vector<unsigned int>(meshIndices.begin(), meshIndices.end()), VertexCount);
+        reports.push_back(report);
+
+        MeshHandle mesh;
+        mesh.mode = GL_TRIANGLES;
+        mesh.count = (GLsizei)IndexCount;
+        mesh.indexType = GL_UNSIGNED_SHORT;
+        indexData.resize((indexData.size() + 1) / 2 * 2);
+        mesh.indexOffset = indexData.size();
+        indexData.resize(mesh.indexOffset + sizeof(meshIndices));
+        std::memcpy(indexData.data() + mesh.indexOffset, meshIndices.data(), sizeof(meshIndices));
+        mesh.baseVertex = (GLint)vertices.size();
+        appendVertices(meshVertices);
+        return mesh;
     }
 
-    if (firstMouse) {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
+    // Cria (ou recria) o VAO com o conteúdo atual do pool
+    void upload() {
+        if (!vao) {
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vbo);
+            glGenBuffers(1, &ebo);
+        }
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size(), indexData.data(), GL_STATIC_DRAW);
+        bindVertexFormat();
     }
 
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos; // invertido: y para cima é positivo
-    lastX = xpos;
-    lastY = ypos;
+    // Outro VAO sobre os mesmos buffers (para ligar buffers de instâncias diferentes). Depois de upload().
+    unsigned int createVertexArray() const {
+        unsigned int array;
+        glGenVertexArrays(1, &array);
+        glBindVertexArray(array);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        bindVertexFormat();
+        return array;
+    }
 
-    float sensitivity = 0.1f;
-    xoffset *= sensitivity;
-    yoffset *= sensitivity;
+    void printStats(std::ostream& out) const {
+        out << "Geometria: " << vertices.size() << " vertices (" << vertices.size() * sizeof(Vertex) << " bytes), "
+            << indexData.size() << " bytes de indices\n";
+        for (const MeshReport& r : reports) {
+            out << "  " << r.name << ": " << r.vertices << " vertices, " << r.triangles << " triangulos, "
+                << r.indexBytes << " bytes de indices | ";
+            if (r.prebuilt)
+                out << "tabela constexpr, ACMR " << r.after.acmr << ", ATVR " << r.after.atvr;
+            else
+                out << "ACMR " << r.before.acmr << " -> " << r.after.acmr << ", ATVR " << r.before.atvr << " -> " << r.after.atvr;
+            out << " (FIFO de " << VERTEX_CACHE_SIZE << ")\n";
+        }
+    }
 
-    yaw += xoffset;
-    pitch += yoffset;
+    unsigned int vao = 0;
 
-    // Limitar pitch para evitar "flipping"
-    if (pitch > 89.0f) pitch = 89.0f;
-    if (pitch < -89.0f) pitch = -89.0f;
-}
+private:
+    // Formato de Vertex no VAO ligado (com o VBO do pool ligado em GL_ARRAY_BUFFER)
+    static void bindVertexFormat() {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
+    }
 
-int main() {
-    if (!glfwInit()) return -1;
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    template <size_t VertexCount>
+    void appendVertices(const std::array<MeshVertex, VertexCount>& meshVertices) {
+        vertices.reserve(vertices.size() + VertexCount);
+        for (const MeshVertex& v : meshVertices)
+            vertices.push_back({ glm::vec3(v.x, v.y, v.z), v.normal });
+    }
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Átomo", nullptr, nullptr);
-    if (!window) {
-        glfwTerminate();
-        return -1;
+    template <typename IndexType>
+    size_t appendIndices(const std::vector<unsigned int>& meshIndices) {
+        // Índices de 32 bits precisam de deslocamento alinhado a 4 bytes
+        indexData.resize((indexData.size() + sizeof(IndexType) - 1) / sizeof(IndexType) * sizeof(IndexType));
+        size_t offset = indexData.size();
+        indexData.resize(offset + meshIndices.size() * sizeof(IndexType));
+        IndexType* out = reinterpret_cast<IndexType*>(indexData.data() + offset);
+        for (size_t i = 0; i < meshIndices.size(); ++i) out[i] = (IndexType)meshIndices[i];
+        return offset;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetMouseButtonCallback(window, mouse_button_callback);
-    glfwSetCursorPosCallback(window, cursor_position_callback);
 
+    struct MeshReport {
+        std::string name;
+        size_t vertices = 0, triangles = 0, indexBytes = 0;
+        bool prebuilt = false;
+        VertexCacheStats before, after;
+    };
 
-    glewExperimental = GL_TRUE;
-    if (glewInit() != GLEW_OK) return -1;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned char> indexData;
+    std::vector<MeshReport> reports;
+    unsigned int vbo = 0, ebo = 0;
+};
 
-    glEnable(GL_DEPTH_TEST);
+// Um desenho pendente. A chave ordena por programa, VAO e material (cor) para agrupar estados iguais.
+struct DrawCommand {
+    uint64_t key;
+    const ShaderProgram* program;
+    unsigned int vao;
+    MeshHandle mesh;
+    GLsizei instanceCount;  // 0 = sem instanciamento
+    glm::mat4 model;
+    glm::vec3 color;
+};
 
-    std::vector<float> sphereVertices;
-    std::vector<float> sphereNormals;
-    std::vector<unsigned int> sphereIndices;
-    generateSphere(sphereVertices, sphereIndices, sphereNormals, 40, 40);
-
-    unsigned int sphereVAO, sphereVBO, sphereEBO, sphereNormalsVBO;
-    glGenVertexArrays(1, &sphereVAO);
-    glGenBuffers(1, &sphereVBO);
-    glGenBuffers(1, &sphereEBO);
-    glGenBuffers(1, &sphereNormalsVBO);
-
-    glBindVertexArray(sphereVAO);
-
-    // Vértices
-    glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-    glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(float), sphereVertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    
-    // Normais
-    glBindBuffer(GL_ARRAY_BUFFER, sphereNormalsVBO);
-    glBufferData(GL_ARRAY_BUFFER, sphereNormals.size() * sizeof(float), sphereNormals.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    
-    // Índices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(unsigned int), sphereIndices.data(), GL_STATIC_DRAW);
-
-
-    // Orbitas XZ, YZ e Diagonal (usa XZ também)
-    std::vector<float> orbitVerticesXZ, orbitVerticesYZ;
-    generateOrbitXZ(orbitVerticesXZ, 2.0f);
-    generateOrbitYZ(orbitVerticesYZ, 2.0f);
-
-    unsigned int orbitVAOXZ, orbitVBOXZ;
-    glGenVertexArrays(1, &orbitVAOXZ);
-    glGenBuffers(1, &orbitVBOXZ);
-    glBindVertexArray(orbitVAOXZ);
-    glBindBuffer(GL_ARRAY_BUFFER, orbitVBOXZ);
-    glBufferData(GL_ARRAY_BUFFER, orbitVerticesXZ.size() * sizeof(float), orbitVerticesXZ.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    unsigned int orbitVAOYZ, orbitVBOYZ;
-    glGenVertexArrays(1, &orbitVAOYZ);
-    glGenBuffers(1, &orbitVBOYZ);
-    glBindVertexArray(orbitVAOYZ);
-    glBindBuffer(GL_ARRAY_BUFFER, orbitVBOYZ);
-    glBufferData(GL_ARRAY_BUFFER, orbitVerticesYZ.size() * sizeof(float), orbitVerticesYZ.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    std::vector<float> orbitVerticesDiag;
-    generateOrbitDiagonal(orbitVerticesDiag, 2.0f);
-
-    unsigned int orbitVAODiag, orbitVBODiag;
-    glGenVertexArrays(1, &orbitVAODiag);
-    glGenBuffers(1, &orbitVBODiag);
-    glBindVertexArray(orbitVAODiag);
-    glBindBuffer(GL_ARRAY_BUFFER, orbitVBODiag);
-    glBufferData(GL_ARRAY_BUFFER, orbitVerticesDiag.size() * sizeof(float), orbitVerticesDiag.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    std::vector<float> orbitVerticesDiagMirror;
-    generateOrbitDiagonal(orbitVerticesDiagMirror, 2.0f);
-
-    unsigned int orbitVAODiagMirror, orbitVBODiagMirror;
-    glGenVertexArrays(1, &orbitVAODiagMirror);
-    glGenBuffers(1, &orbitVBODiagMirror);
-    glBindVertexArray(orbitVAODiagMirror);
-    glBindBuffer(GL_ARRAY_BUFFER, orbitVBODiagMirror);
-    glBufferData(GL_ARRAY_BUFFER, orbitVerticesDiagMirror.size() * sizeof(float), orbitVerticesDiagMirror.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    unsigned int shaderProgram = createShaderProgram();
-    unsigned int lightShaderProgram = shaderProgram; // Usamos o mesmo shader para simplificar
-
-    // Posição da câmera (view position)
-    glm::vec3 cameraPos(0.0f, 0.0f, 6.0f);
-
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
-        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Contadores de um frame, para acompanhar o custo de driver conforme a cena cresce
+struct RenderStats {
+    unsigned int drawCalls = 0;
+    unsigned int programBinds = 0;
+    unsigned int vaoBinds = 0;
+    unsigned int uniformUploads = 0;
+    uint64_t triangles = 0;
 
-        float time = glfwGetTime();
-        
-        glm::vec3 cameraTarget(0.0f, 0.0f, 0.0f);
-        glm::vec3 cameraPos;
-        cameraPos.x = cameraTarget.x + cameraDistance * cos(glm::radians(pitch)) * cos(glm::radians(yaw));
-        cameraPos.y = cameraTarget.y + cameraDistance * sin(glm::radians(pitch));
-        cameraPos.z = cameraTarget.z + cameraDistance * cos(glm::radians(pitch)) * sin(glm::radians(yaw));
-
-        glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(SCR_WIDTH) / SCR_HEIGHT, 0.1f, 100.0f);
-        
+    unsigned int stateChanges() const { return programBinds + vaoBinds + uniformUploads; }
+};
+
+// Fila de desenho: acumula os comandos do frame, ordena e envia pulando estados repetidos
+class RenderQueue {
+public:
+    void draw(const ShaderProgram& program, unsigned int vao, const MeshHandle& mesh,
+              const glm::mat4& model, const glm::vec3& color) {
+        push(program, vao, mesh, 0, model, color);
+    }
+
+    // As instâncias já devem estar no buffer ligado ao VAO
+    void drawInstanced(const ShaderProgram& program, unsigned int vao, const MeshHandle& mesh, GLsizei instanceCount) {
+        if (instanceCount > 0)
+            push(program, vao, mesh, instanceCount, glm::mat4(1.0f), glm::vec3(0.0f));
+    }
+
+    void submit() {
+        stats = RenderStats();
+        std::stable_sort(commands.begin(), commands.end(),
+                         [](const DrawCommand& a, const DrawCommand& b) { return a.key < b.key; });
 
-        int viewPosLoc = glGetUniformLocation(shaderProgram, "viewPos");
-        glUniform3fv(viewPosLoc, 1, &cameraPos[0]);
-
-        glUseProgram(shaderProgram);
-        // Configurar propriedades de luz
-        glm::vec3 lightPos = cameraPos;
-        glUniform3f(glGetUniformLocation(shaderProgram, "lightPos"), lightPos.x, lightPos.y, lightPos.z);
-        glUniform3f(glGetUniformLocation(shaderProgram, "viewPos"), cameraPos.x, cameraPos.y, cameraPos.z);
-        glUniform3f(glGetUniformLocation(shaderProgram, "lightColor"), 1.0f, 1.0f, 1.0f);
-
-        // Matrizes de visualização e projeção
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, &view[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, &projection[0][0]);
-
-        // Núcleo
-        glBindVertexArray(sphereVAO);
-        glm::mat4 modelNucleus = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &modelNucleus[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 0.0f, 0.0f, 1.0f); // vermelho
-        glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-
-        // Elétron 1 (horizontal)
-        glm::mat4 modelElectron1 = glm::rotate(glm::mat4(1.0f), time, glm::vec3(0, 1, 0));
-        modelElectron1 = glm::translate(modelElectron1, glm::vec3(2.0f, 0.0f, 0.0f));
-        modelElectron1 = glm::scale(modelElectron1, glm::vec3(0.2f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &modelElectron1[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-
-        // Elétron 2 (vertical)
-        glm::mat4 modelElectron2 = glm::rotate(glm::mat4(1.0f), time, glm::vec3(1, 0, 0));
-        modelElectron2 = glm::translate(modelElectron2, glm::vec3(0.0f, 0.0f, 2.0f));
-        modelElectron2 = glm::scale(modelElectron2, glm::vec3(0.2f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &modelElectron2[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-
-        glm::mat4 modelElectron3 = glm::mat4(1.0f);
-        // Inclinação do plano (primeiro)
-        modelElectron3 = glm::rotate(modelElectron3, glm::radians(45.0f), glm::vec3(1, 0, 0));
-        modelElectron3 = glm::rotate(modelElectron3, glm::radians(45.0f), glm::vec3(0, 1, 0));
-
-        // Rotação em torno do núcleo
-        modelElectron3 = glm::rotate(modelElectron3, time, glm::vec3(0, 1, 0));
-
-        // Translação ao longo da órbita
-        modelElectron3 = glm::translate(modelElectron3, glm::vec3(2.0f, 0.0f, 0.0f));
-
-        // Escala
-        modelElectron3 = glm::scale(modelElectron3, glm::vec3(0.2f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &modelElectron3[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-
-        // Elétron 4 (diagonal)
-        glm::mat4 modelElectronDiag = glm::mat4(1.0f);
-        modelElectronDiag = glm::rotate(modelElectronDiag, glm::radians(45.0f), glm::vec3(1, 0, 0));
-        modelElectronDiag = glm::rotate(modelElectronDiag, glm::radians(45.0f), glm::vec3(0, 0, 1));
-        modelElectronDiag = glm::rotate(modelElectronDiag, time, glm::vec3(0, 1, 0));  // rotação no plano já inclinado
-        modelElectronDiag = glm::translate(modelElectronDiag, glm::vec3(2.0f, 0.0f, 0.0f));
-        modelElectronDiag = glm::scale(modelElectronDiag, glm::vec3(0.2f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &modelElectronDiag[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-
-        glm::mat4 modelElectronDiagMirror = glm::mat4(1.0f);
-        modelElectronDiagMirror = glm::rotate(modelElectronDiagMirror, glm::radians(-45.0f), glm::vec3(1, 0, 0));
-        modelElectronDiagMirror = glm::rotate(modelElectronDiagMirror, glm::radians(-45.0f), glm::vec3(0, 0, 1));
-        modelElectronDiagMirror = glm::rotate(modelElectronDiagMirror, time, glm::vec3(0, 1, 0));
-        modelElectronDiagMirror = glm::translate(modelElectronDiagMirror, glm::vec3(2.0f, 0.0f, 0.0f));
-        modelElectronDiagMirror = glm::scale(modelElectronDiagMirror, glm::vec3(0.2f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &modelElectronDiagMirror[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-
-
-        // Órbita XZ
-        glBindVertexArray(orbitVAOXZ);
-        glm::mat4 orbitModel1 = glm::mat4(1.0f);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &orbitModel1[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "color"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawArrays(GL_LINE_LOOP, 0, orbitVerticesXZ.size() / 3);
-
-        // Órbita YZ
-        glBindVertexArray(orbitVAOYZ);
-        glm::mat4 orbitModel2 = glm::mat4(1.0f);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &orbitModel2[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "color"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawArrays(GL_LINE_LOOP, 0, orbitVerticesYZ.size() / 3);
-
-        // Órbita Diagonal (reutilizando XZ com rotação)
-        glBindVertexArray(orbitVAOXZ);
-        glm::mat4 orbitModelDiagonal = glm::rotate(glm::mat4(1.0f), glm::radians(45.0f), glm::vec3(1, 0, 0));
-        orbitModelDiagonal = glm::rotate(orbitModelDiagonal, glm::radians(45.0f), glm::vec3(0, 1, 0));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &orbitModelDiagonal[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "color"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawArrays(GL_LINE_LOOP, 0, orbitVerticesXZ.size() / 3);
-
-        // Órbita Diagonal (reutilizando YZ com rotação)
-        glBindVertexArray(orbitVAODiag);
-        glm::mat4 orbitModelDiag = glm::mat4(1.0f);
-        orbitModelDiag = glm::rotate(orbitModelDiag, glm::radians(45.0f), glm::vec3(1, 0, 0)); // inclinação no X
-        orbitModelDiag = glm::rotate(orbitModelDiag, glm::radians(45.0f), glm::vec3(0, 0, 1)); // inclinação no Z
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &orbitModelDiag[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "color"), 1.0f, 0.6f, 0.0f); // cor laranja
-        glDrawArrays(GL_LINE_LOOP, 0, orbitVerticesDiag.size() / 3);
-
-        // Órbita Diagonal (espelho)
-        glBindVertexArray(orbitVAODiagMirror);
-        glm::mat4 orbitModelDiagMirror = glm::mat4(1.0f);
-        orbitModelDiagMirror = glm::rotate(orbitModelDiagMirror, glm::radians(-45.0f), glm::vec3(1, 0, 0)); // inverso do X
-        orbitModelDiagMirror = glm::rotate(orbitModelDiagMirror, glm::radians(-45.0f), glm::vec3(0, 0, 1)); // inverso do Z
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &orbitModelDiagMirror[0][0]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "color"), 1.0f, 0.6f, 0.0f); // cor laranja igual à anterior
-        glDrawArrays(GL_LINE_LOOP, 0, orbitVerticesDiagMirror.size() / 3);
-
-        glfwSwapBuffers(window);
+        const ShaderProgram* boundProgram = nullptr;
+        unsigned int boundVAO = 0;
+        bool hasModel = false, hasColor = false;
+        glm::mat4 lastModel;
+        glm::vec3 lastColor;
+        for (const DrawCommand& cmd : commands) {
+            if (cmd.program != boundProgram) {
+                glUseProgram(cmd.program->id);
+                boundProgram = cmd.program;
+                hasModel = hasColor = false; // uniforms são estado de cada programa
+                ++stats.programBinds;
+            }
+            if (cmd.vao != boundVAO) {
+                glBindVertexArray(cmd.vao);
+                boundVAO = cmd.vao;
+                ++stats.vaoBinds;
+            }
+            if (cmd.program->model >= 0 && !(hasModel && lastModel == cmd.model)) {
+                glUniformMatrix4fv(cmd.program->model, 1, GL_FALSE, &cmd.model[0][0]);
+                lastModel = cmd.model;
+                hasModel = true;
+                ++stats.uniformUploads;
+            }
+            if (cmd.program->objectColor >= 0 && !(hasColor && lastColor == cmd.color)) {
+                glUniform3f(cmd.program->objectColor, cmd.color.x, cmd.color.y, cmd.color.z);
+                lastColor = cmd.color;
+                hasColor = true;
+                ++stats.uniformUploads;
+            }
+
+            const MeshHandle& mesh = cmd.mesh;
+            if (cmd.instanceCount > 0) {
+                if (mesh.indexType)
+                    glDrawElementsInstancedBaseVertex(mesh.mode, mesh.count, mesh.indexType, (void*)mesh.indexOffset,
+                                                      cmd.instanceCount, mesh.baseVertex);
+                else
+                    glDrawArraysInstanced(mesh.mode, mesh.baseVertex, mesh.count, cmd.instanceCount);
+            } else {
+                if (mesh.indexType)
+                    glDrawElementsBaseVertex(mesh.mode, mesh.count, mesh.indexType, (void*)mesh.indexOffset, mesh.baseVertex);
+                else
+                    glDrawArrays(mesh.mode, mesh.baseVertex, mesh.count);
+            }
+            ++stats.drawCalls;
+            uint64_t triangles = mesh.mode == GL_TRIANGLES ? mesh.count / 3 : mesh.mode == GL_TRIANGLE_STRIP ? std::max(0, mesh.count - 2) : 0;
+            stats.triangles += triangles * std::max<GLsizei>(1, cmd.instanceCount);
+        }
+        commands.clear();
+    }
+
+    RenderStats stats;
+
+private:
+    void push(const ShaderProgram& program, unsigned int vao, const MeshHandle& mesh,
+              GLsizei instanceCount, const glm::mat4& model, const glm::vec3& color) {
+        DrawCommand cmd;
+        uint64_t material = (uint64_t(glm::clamp(color.x, 0.0f, 1.0f) * 255.0f) << 16) |
+                            (uint64_t(glm::clamp(color.y, 0.0f, 1.0f) * 255.0f) << 8) |
+                             uint64_t(glm::clamp(color.z, 0.0f, 1.0f) * 255.0f);
+        cmd.key = (uint64_t(program.id & 0xFFFF) << 48) | (uint64_t(vao & 0xFFFF) << 32) | material;
+        cmd.program = &program;
+        cmd.vao = vao;
+        cmd.mesh = mesh;
+        cmd.instanceCount = instanceCount;
+        cmd.model = model;
+        cmd.color = color;
+        commands.push_back(cmd);
+    }
+
+    std::vector<DrawCommand> commands;
+};
+
+// Dados por instância de um elétron (matriz de modelo + cor), enviados num único buffer
+struct ElectronInstance {
+    glm::mat4 model;
+    glm::vec3 color;
+};
+
+// Matriz de modelo de um elétron em uma das cinco órbitas do modelo
+glm::mat4 electronModel(int orbit, float angle) {
+    glm::mat4 model = glm::mat4(1.0f);
+    switch (orbit % 5) {
+    case 0: // horizontal
+        model = glm::rotate(model, angle, glm::vec3(0, 1, 0));
+        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
+        break;
+    case 1: // vertical
+        model = glm::rotate(model, angle, glm::vec3(1, 0, 0));
+        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 2.0f));
+        break;
+    case 2: // inclinado em X e Y
+        model = glm::rotate(model, glm::radians(45.0f), glm::vec3(1, 0, 0));
+        model = glm::rotate(model, glm::radians(45.0f), glm::vec3(0, 1, 0));
+        model = glm::rotate(model, angle, glm::vec3(0, 1, 0));
+        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
+        break;
+    case 3: // diagonal
+        model = glm::rotate(model, glm::radians(45.0f), glm::vec3(1, 0, 0));
+        model = glm::rotate(model, glm::radians(45.0f), glm::vec3(0, 0, 1));
+        model = glm::rotate(model, angle, glm::vec3(0, 1, 0));
+        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
+        break;
+    default: // diagonal (espelho)
+        model = glm::rotate(model, glm::radians(-45.0f), glm::vec3(1, 0, 0));
+        model = glm::rotate(model, glm::radians(-45.0f), glm::vec3(0, 0, 1));
+        model = glm::rotate(model, angle, glm::vec3(0, 1, 0));
+        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
+        break;
+    }
+    return glm::scale(model, glm::vec3(0.2f));
+}
+
+// Preenche as instâncias de `count` elétrons distribuídos pelas cinco órbitas.
+// Os cinco primeiros ficam exatamente onde o modelo original os desenhava.
+void buildElectronInstances(std::vector<ElectronInstance>& instances, size_t count, float time) {
+    instances.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        // Defasagem (ângulo áureo) para que elétrons da mesma órbita não se sobreponham
+        float phase = float(i / 5) * 2.39996323f;
+        instances[i].model = electronModel(int(i % 5), time + phase);
+        instances[i].color = glm::vec3(1.0f, 0.6f, 0.0f); // cor laranja
+    }
+}
+
+// Liga o buffer de instâncias ao VAO da esfera (matriz nas locations 2-5, cor na 6), a partir de `offset` bytes
+void setupElectronInstancing(unsigned int vao, unsigned int instanceVBO, size_t offset = 0) {
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (int i = 0; i < 4; ++i) {
+        glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(ElectronInstance), (void*)(offset + i * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(2 + i);
+        glVertexAttribDivisor(2 + i, 1);
+    }
+    glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(ElectronInstance), (void*)(offset + offsetof(ElectronInstance, color)));
+    glEnableVertexAttribArray(6);
+    glVertexAttribDivisor(6, 1);
+}
+
+// Envia as instâncias (recriando o armazenamento, o que evita esperar pelo frame anterior)
+void uploadElectronInstances(unsigned int instanceVBO, const std::vector<ElectronInstance>& instances) {
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(ElectronInstance), instances.data(), GL_STREAM_DRAW);
+}
+
+// Todos os elétrons numa única chamada instanciada
+void queueElectronsInstanced(RenderQueue& queue, const ShaderProgram& program, unsigned int vao, unsigned int instanceVBO,
+                             const std::vector<ElectronInstance>& instances, const MeshHandle& sphere) {
+    uploadElectronInstances(instanceVBO, instances);
+    queue.drawInstanced(program, vao, sphere, (GLsizei)instances.size());
+}
+
+// Caminho antigo: um glDrawElements (e um glUniform para o modelo) por elétron. Mantido para comparação.
+void queueElectronsLegacy(RenderQueue& queue, const ShaderProgram& program, unsigned int vao,
+                          const std::vector<ElectronInstance>& instances, const MeshHandle& sphere) {
+    for (const ElectronInstance& e : instances)
+        queue.draw(program, vao, sphere, e.model, e.color);
+}
+
+// ---- Upload em anel ----
+
+// Regiões do anel: a CPU escreve numa enquanto a GPU ainda pode estar lendo as dos dois frames anteriores
+const unsigned int STREAM_REGIONS = 3;
+// Folga por região para os alinhamentos das alocações do frame
+const size_t STREAM_SLACK = 4096;
+// Maior GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT permitido pela especificação; as regiões começam alinhadas a ele
+const size_t STREAM_ALIGNMENT = 256;
+
+enum class StreamMode { Coherent, Flush, Orphan };
+
+const char* streamModeName(StreamMode mode) {
+    switch (mode) {
+    case StreamMode::Coherent: return "coerente";
+    case StreamMode::Flush: return "flush";
+    default: return "orfao";
+    }
+}
+
+// Dados dinâmicos do frame (uniforms da câmera e instâncias) escritos direto na memória de um buffer.
+// Com GL_ARB_buffer_storage o buffer fica mapeado o tempo todo (coerente, ou com flush explícito dos bytes
+// escritos) e cada região só volta a ser escrita depois que a cerca do frame que a usou passou. Sem a
+// extensão, o frame é montado numa cópia em memória e enviado com glBufferData (órfão) + glBufferSubData.
+class StreamBuffer {
+public:
+    struct Allocation {
+        void* data;
+        size_t offset; // no buffer, para glVertexAttribPointer e glBindBufferRange
+    };
+
+    // Devolve o modo realmente usado (Orphan quando não há GL_ARB_buffer_storage)
+    StreamMode init(StreamMode requested, size_t regionBytes) {
+        mode = requested;
+        if (mode != StreamMode::Orphan && !GLEW_ARB_buffer_storage && !GLEW_VERSION_4_4) mode = StreamMode::Orphan;
+        allocateStorage(regionBytes);
+        return mode;
+    }
+
+    // Começa o frame na próxima região, com espaço para `bytes` (mais a folga dos alinhamentos).
+    // Espera a cerca da região se a GPU ainda não terminou o frame que a usou.
+    void beginFrame(size_t bytes) {
+        bytesThisFrame = 0;
+        waitMilliseconds = 0.0;
+        if (bytes + STREAM_SLACK > regionSize) {
+            // Crescer troca o buffer inteiro: nenhuma região pode estar em uso
+            for (unsigned int r = 0; r < STREAM_REGIONS; ++r) waitFence(r);
+            releaseStorage();
+            allocateStorage(std::max(bytes + STREAM_SLACK, regionSize + regionSize / 2));
+        }
+        region = (region + 1) % STREAM_REGIONS;
+        waitFence(region);
+        head = 0;
+    }
+
+    // Só cabe o que foi contado em beginFrame (mais STREAM_SLACK de alinhamento). Passar disso escreveria na
+    // região que a GPU ainda pode estar lendo, então é um erro de programação: para aqui em vez de corromper
+    Allocation allocate(size_t bytes, size_t alignment) {
+        head = (head + alignment - 1) / alignment * alignment;
+        if (head + bytes > regionSize) {
+            std::cerr << "StreamBuffer: alocacao de " << bytes << " bytes passa da regiao de " << regionSize
+                      << " bytes (faltou conta-la em beginFrame)" << std::endl;
+            std::abort();
+        }
+        size_t base = mode == StreamMode::Orphan ? 0 : region * regionSize;
+        Allocation allocation = { (mode == StreamMode::Orphan ? staging.data() : mapped) + base + head, base + head };
+        head += bytes;
+        bytesThisFrame += bytes;
+        return allocation;
+    }
+
+    // Torna o que foi escrito visível para a GPU; chamar depois das escritas e antes dos draws
+    void flush() {
+        if (mode == StreamMode::Coherent || head == 0) return;
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        if (mode == StreamMode::Flush) {
+            glFlushMappedBufferRange(GL_ARRAY_BUFFER, region * regionSize, head);
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, regionSize, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, head, staging.data());
+        }
+    }
+
+    // Depois dos draws do frame: a região fica protegida até a GPU passar por esta cerca
+    void endFrame() {
+        if (mode != StreamMode::Orphan) fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    GLuint buffer() const { return id; }
+
+    StreamMode mode = StreamMode::Orphan;
+    size_t bytesThisFrame = 0;
+    double waitMilliseconds = 0.0; // esperando cercas neste frame
+
+private:
+    void allocateStorage(size_t bytes) {
+        regionSize = (bytes + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        if (mode == StreamMode::Orphan) {
+            staging.resize(regionSize);
+            glBufferData(GL_ARRAY_BUFFER, regionSize, nullptr, GL_STREAM_DRAW);
+            return;
+        }
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | (mode == StreamMode::Coherent ? GL_MAP_COHERENT_BIT : 0);
+        glBufferStorage(GL_ARRAY_BUFFER, regionSize * STREAM_REGIONS, nullptr, flags);
+        mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * STREAM_REGIONS,
+                                            flags | (mode == StreamMode::Flush ? GL_MAP_FLUSH_EXPLICIT_BIT : 0));
+    }
+
+    void releaseStorage() {
+        if (mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, id);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &id);
+    }
+
+    void waitFence(unsigned int r) {
+        if (!fences[r]) return;
+        auto start = std::chrono::steady_clock::now();
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(fences[r], flags, 1000000000) == GL_TIMEOUT_EXPIRED) flags = 0;
+        waitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glDeleteSync(fences[r]);
+        fences[r] = nullptr;
+    }
+
+    GLuint id = 0;
+    uint8_t* mapped = nullptr;
+    std::vector<uint8_t> staging; // só no modo órfão
+    size_t regionSize = 0, head = 0;
+    unsigned int region = 0;
+    GLsync fences[STREAM_REGIONS] = {};
+};
+
+// Uniforms do frame escritos no anel e ligados ao binding do bloco FrameData
+void streamFrameUniforms(StreamBuffer& stream, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos,
+                         float time) {
+    StreamBuffer::Allocation frame = stream.allocate(sizeof(FrameUniforms), STREAM_ALIGNMENT);
+    *(FrameUniforms*)frame.data = makeFrameUniforms(view, projection, cameraPos, time);
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, stream.buffer(), frame.offset, sizeof(FrameUniforms));
+}
+
+// Parâmetros de uma órbita, lidos pelo vertex shader como atributos por instância
+struct OrbitParams {
+    glm::vec4 centerRadius;  // xyz = centro, w = semi-eixo maior
+    glm::vec4 orientation;   // quaternion do plano (x, y, z, w)
+    glm::vec4 shape;         // x = semi-eixo menor, y = precessão (rad/s), z = fase da precessão
+    glm::vec4 color;
+};
+
+// Pontos por anel; todas as órbitas usam a mesma resolução
+const GLsizei ORBIT_SEGMENTS = 128;
+
+// Todas as órbitas num único glDrawArraysInstanced. Adicionar uma órbita só acrescenta 64 bytes
+// ao buffer de parâmetros (que cresce em dobro, sem um buffer novo por órbita).
+class OrbitRenderer {
+public:
+    void init() {
+        program = loadShaderProgram(orbitVertexShaderSource, orbitFragmentShaderSource);
+        glUseProgram(program.id);
+        glUniform1i(glGetUniformLocation(program.id, "segments"), ORBIT_SEGMENTS);
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &paramsVBO);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, paramsVBO);
+        for (int i = 0; i < 4; ++i) {
+            glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(OrbitParams), (void*)(i * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
+        }
+        ring.mode = GL_LINE_LOOP;
+        ring.count = ORBIT_SEGMENTS;
+    }
+
+    // Órbita elíptica (semiMinor = radius para círculo) no plano XZ girado por `orientation`
+    size_t addOrbit(const glm::vec3& center, float radius, const glm::quat& orientation, const glm::vec3& color,
+                    float semiMinor = 0.0f, float precessionSpeed = 0.0f, float precessionPhase = 0.0f) {
+        OrbitParams params;
+        params.centerRadius = glm::vec4(center, radius);
+        params.orientation = glm::vec4(orientation.x, orientation.y, orientation.z, orientation.w);
+        params.shape = glm::vec4(semiMinor > 0.0f ? semiMinor : radius, precessionSpeed, precessionPhase, 0.0f);
+        params.color = glm::vec4(color, 1.0f);
+        orbits.push_back(params);
+        dirty = true;
+        return orbits.size() - 1;
+    }
+
+    void clear() {
+        orbits.clear();
+        dirty = true;
+    }
+
+    size_t count() const { return orbits.size(); }
+
+    // Parâmetros prontos, na ordem em que foram adicionados (gravados e lidos de volta pelas trajetórias)
+    const std::vector<OrbitParams>& params() const { return orbits; }
+
+    void assign(const OrbitParams* params, size_t count) {
+        orbits.assign(params, params + count);
+        dirty = true;
+    }
+
+    void queue(RenderQueue& renderQueue) {
+        if (orbits.empty()) return;
+        if (dirty) {
+            glBindBuffer(GL_ARRAY_BUFFER, paramsVBO);
+            if (orbits.size() > capacity) {
+                capacity = std::max(orbits.size(), capacity * 2);
+                glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(OrbitParams), nullptr, GL_DYNAMIC_DRAW);
+            }
+            glBufferSubData(GL_ARRAY_BUFFER, 0, orbits.size() * sizeof(OrbitParams), orbits.data());
+            dirty = false;
+        }
+        renderQueue.drawInstanced(program, vao, ring, (GLsizei)orbits.size());
+    }
+
+private:
+    ShaderProgram program;
+    unsigned int vao = 0, paramsVBO = 0;
+    MeshHandle ring;
+    std::vector<OrbitParams> orbits;
+    size_t capacity = 0;
+    bool dirty = false;
+};
+
+// ---- Tabela periódica e cena ----
+
+// Tabela embutida: "Z Símbolo [configuração]". Sem configuração, a distribuição segue a regra de
+// Madelung; as exceções conhecidas vêm escritas. Um arquivo passado com --tabela usa o mesmo formato.
+const char* ELEMENT_TABLE = R"table(
+1 H; 2 He; 3 Li; 4 Be; 5 B; 6 C; 7 N; 8 O; 9 F; 10 Ne
+11 Na; 12 Mg; 13 Al; 14 Si; 15 P; 16 S; 17 Cl; 18 Ar; 19 K; 20 Ca
+21 Sc; 22 Ti; 23 V; 24 Cr [Ar] 3d5 4s1; 25 Mn; 26 Fe; 27 Co; 28 Ni; 29 Cu [Ar] 3d10 4s1; 30 Zn
+31 Ga; 32 Ge; 33 As; 34 Se; 35 Br; 36 Kr; 37 Rb; 38 Sr; 39 Y; 40 Zr
+41 Nb [Kr] 4d4 5s1; 42 Mo [Kr] 4d5 5s1; 43 Tc; 44 Ru [Kr] 4d7 5s1; 45 Rh [Kr] 4d8 5s1
+46 Pd [Kr] 4d10; 47 Ag [Kr] 4d10 5s1; 48 Cd; 49 In; 50 Sn
+51 Sb; 52 Te; 53 I; 54 Xe; 55 Cs; 56 Ba; 57 La [Xe] 5d1 6s2; 58 Ce [Xe] 4f1 5d1 6s2; 59 Pr; 60 Nd
+61 Pm; 62 Sm; 63 Eu; 64 Gd [Xe] 4f7 5d1 6s2; 65 Tb; 66 Dy; 67 Ho; 68 Er; 69 Tm; 70 Yb
+71 Lu; 72 Hf; 73 Ta; 74 W; 75 Re; 76 Os; 77 Ir; 78 Pt [Xe] 4f14 5d9 6s1; 79 Au [Xe] 4f14 5d10 6s1; 80 Hg
+81 Tl; 82 Pb; 83 Bi; 84 Po; 85 At; 86 Rn; 87 Fr; 88 Ra; 89 Ac [Rn] 6d1 7s2; 90 Th [Rn] 6d2 7s2
+91 Pa [Rn] 5f2 6d1 7s2; 92 U [Rn] 5f3 6d1 7s2; 93 Np [Rn] 5f4 6d1 7s2; 94 Pu; 95 Am
+96 Cm [Rn] 5f7 6d1 7s2; 97 Bk; 98 Cf; 99 Es; 100 Fm
+101 Md; 102 No; 103 Lr [Rn] 5f14 7s2 7p1; 104 Rf; 105 Db; 106 Sg; 107 Bh; 108 Hs; 109 Mt; 110 Ds
+111 Rg; 112 Cn; 113 Nh; 114 Fl; 115 Mc; 116 Lv; 117 Ts; 118 Og
+)table";
+
+// Moléculas embutidas, no formato XYZ (coordenadas em angstrom)
+const char* MOLECULE_WATER = "3\nagua\nO 0 0 0\nH 0.757 0.586 0\nH -0.757 0.586 0\n";
+const char* MOLECULE_CO2 = "3\ndioxido de carbono\nC 0 0 0\nO 1.16 0 0\nO -1.16 0 0\n";
+const char* MOLECULE_METHANE = "5\nmetano\nC 0 0 0\nH 0.629 0.629 0.629\nH -0.629 -0.629 0.629\nH -0.629 0.629 -0.629\nH 0.629 -0.629 -0.629\n";
+
+const unsigned int MAX_ELEMENT = 118;
+
+// Um subnível: número quântico principal n, secundário l (0 = s, 1 = p, 2 = d, 3 = f) e ocupação
+struct Subshell {
+    uint8_t n, l, electrons;
+};
+
+struct Element {
+    std::string symbol;
+    std::vector<Subshell> subshells;
+};
+
+// Preenche `electrons` elétrons na ordem de Madelung (n + l crescente, depois n)
+std::vector<Subshell> madelungConfiguration(unsigned int electrons) {
+    std::vector<Subshell> subshells;
+    for (unsigned int sum = 1; electrons > 0; ++sum) {
+        for (int l = (int)(sum - 1) / 2; l >= 0 && electrons > 0; --l) {
+            int n = (int)sum - l;
+            if (n <= l) continue;
+            unsigned int capacity = 2 * (2 * l + 1);
+            uint8_t count = (uint8_t)std::min(capacity, electrons);
+            subshells.push_back({ (uint8_t)n, (uint8_t)l, count });
+            electrons -= count;
+        }
+    }
+    return subshells;
+}
+
+class ElementTable {
+public:
+    ElementTable() : elements(MAX_ELEMENT + 1) {}
+
+    // Lê entradas "Z Símbolo [configuração]" separadas por ';' ou quebra de linha ('#' inicia comentário).
+    // Entradas novas substituem as já carregadas. Devolve false se alguma linha for inválida.
+    bool load(std::istream& in, std::ostream& errors) {
+        bool ok = true;
+        std::string line;
+        while (std::getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            std::stringstream entries(line);
+            std::string entry;
+            while (std::getline(entries, entry, ';')) {
+                std::stringstream fields(entry);
+                unsigned int z = 0;
+                std::string symbol;
+                if (!(fields >> z)) continue; // linha vazia
+                if (z < 1 || z > MAX_ELEMENT || !(fields >> symbol)) {
+                    errors << "Tabela: entrada invalida '" << entry << "'\n";
+                    ok = false;
+                    continue;
+                }
+                std::vector<Subshell> subshells;
+                std::string token;
+                bool hasConfiguration = false;
+                while (fields >> token) {
+                    hasConfiguration = true;
+                    if (!parseConfigurationToken(token, subshells)) {
+                        errors << "Tabela: configuracao invalida '" << token << "' em " << symbol << "\n";
+                        ok = false;
+                    }
+                }
+                if (!hasConfiguration) subshells = madelungConfiguration(z);
+                unsigned int total = 0;
+                for (const Subshell& s : subshells) total += s.electrons;
+                if (total != z) {
+                    errors << "Tabela: " << symbol << " tem " << total << " eletrons, esperado " << z << "\n";
+                    ok = false;
+                }
+                elements[z].symbol = symbol;
+                elements[z].subshells = subshells;
+            }
+        }
+        return ok;
+    }
+
+    // Aceita o número atômico ("92") ou o símbolo ("U")
+    unsigned int find(const std::string& name) const {
+        if (!name.empty() && std::isdigit((unsigned char)name[0])) {
+            unsigned int z = (unsigned int)std::atoi(name.c_str());
+            return z >= 1 && z <= MAX_ELEMENT && !elements[z].symbol.empty() ? z : 0;
+        }
+        for (unsigned int z = 1; z <= MAX_ELEMENT; ++z)
+            if (elements[z].symbol == name) return z;
+        return 0;
+    }
+
+    const Element& operator[](unsigned int z) const { return elements[z]; }
+
+private:
+    // "[Ar]" expande o caroço de gás nobre; "3d5" é um subnível
+    static bool parseConfigurationToken(const std::string& token, std::vector<Subshell>& subshells) {
+        if (token.size() >= 3 && token.front() == '[' && token.back() == ']') {
+            static const std::pair<const char*, unsigned int> cores[] = {
+                { "He", 2 }, { "Ne", 10 }, { "Ar", 18 }, { "Kr", 36 }, { "Xe", 54 }, { "Rn", 86 },
+            };
+            for (const auto& core : cores) {
+                if (token.compare(1, token.size() - 2, core.first) == 0) {
+                    std::vector<Subshell> filled = madelungConfiguration(core.second);
+                    subshells.insert(subshells.end(), filled.begin(), filled.end());
+                    return true;
+                }
+            }
+            return false;
+        }
+        static const char letters[] = "spdf";
+        size_t pos = 0;
+        while (pos < token.size() && std::isdigit((unsigned char)token[pos])) ++pos;
+        if (pos == 0 || pos >= token.size()) return false;
+        const char* letter = std::strchr(letters, token[pos]);
+        if (!letter || *letter == '\0') return false;
+        int n = std::atoi(token.substr(0, pos).c_str());
+        int l = int(letter - letters);
+        int count = pos + 1 < token.size() ? std::atoi(token.c_str() + pos + 1) : 1;
+        if (n <= l || count < 1 || count > 2 * (2 * l + 1)) return false;
+        subshells.push_back({ (uint8_t)n, (uint8_t)l, (uint8_t)count });
+        return true;
+    }
+
+    std::vector<Element> elements;
+};
+
+// Cores por tipo de subnível (s, p, d, f). O índice 0 é o laranja do modelo original.
+const glm::vec3 ELECTRON_COLORS[] = {
+    { 1.0f, 0.6f, 0.0f }, { 0.85f, 0.2f, 0.2f }, { 0.2f, 0.65f, 0.3f }, { 0.55f, 0.3f, 0.8f },
+};
+const glm::vec3 ORBIT_COLORS[] = {
+    { 0.0f, 0.0f, 0.0f }, { 0.45f, 0.1f, 0.1f }, { 0.1f, 0.35f, 0.15f }, { 0.3f, 0.15f, 0.45f },
+};
+
+// ---- Kernel em lote das matrizes dos elétrons ----
+
+// Com a base do plano (colunas u, n, v de mat3_cast(plane)) calculada uma vez, a matriz de um elétron
+// sai de um seno e um cosseno:
+//   eixo X = u cos - v sin,  eixo Z = u sin + v cos,  posição = centro + r * eixo X
+// O kernel faz isso para 8 elétrons por vez (SSE2: 2 x 4, AVX2: 1 x 8), escolhendo o caminho em tempo
+// de execução. Os três caminhos fazem as mesmas operações na mesma ordem e dão o mesmo resultado bit a bit.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ATOMO_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define ATOMO_TARGET_AVX2
+#else
+#define ATOMO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::SSE2: return "SSE2";
+    default: return "escalar";
+    }
+}
+
+// Maior nível suportado pela CPU (e pelo sistema, no caso dos registradores de 256 bits)
+SimdLevel detectSimdLevel() {
+#if defined(ATOMO_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    if (osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6) return SimdLevel::AVX2;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+#endif
+    return SimdLevel::SSE2; // parte do x86-64 (e exigido pelo compilador em 32 bits)
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// Campos constantes de cada órbita, um array por componente: a base do plano e o centro
+enum OrbitFrameField {
+    FRAME_UX, FRAME_UY, FRAME_UZ,   // eixo X do plano (posição do elétron na fase 0)
+    FRAME_NX, FRAME_NY, FRAME_NZ,   // normal do plano
+    FRAME_VX, FRAME_VY, FRAME_VZ,   // eixo Z do plano
+    FRAME_CX, FRAME_CY, FRAME_CZ,   // centro da órbita
+    FRAME_FIELDS
+};
+
+// Entrada do kernel: arrays paralelos de `count` elétrons
+struct ElectronKernelInput {
+    const float* frame[FRAME_FIELDS];
+    const float* phase;
+    const float* radius;
+    const uint8_t* colorIndex;
+    size_t count;
+};
+
+// Instância compacta: posição + escala e cor RGBA8 (20 bytes no lugar dos 76 da matriz + cor)
+struct CompactInstance {
+    glm::vec3 position;
+    float scale;
+    uint32_t color;
+};
+
+const size_t ELECTRON_BLOCK = 8;
+
+// Saída de um bloco, por componente: eixo X (0-2), eixo Z (3-5) e posição (6-8)
+struct ElectronBlock {
+    alignas(32) float lanes[9][ELECTRON_BLOCK];
+};
+
+// Constantes do seno/cosseno (redução de Cody-Waite em pi/2 e polinômios de grau 7 e 8, como na Cephes)
+const float SINCOS_TWO_OVER_PI = 0.636619772f;
+const float SINCOS_DP1 = 1.5703125f, SINCOS_DP2 = 4.837512969970703125e-4f, SINCOS_DP3 = 7.54978995489188216e-8f;
+const float SINCOS_S0 = -1.6666654611e-1f, SINCOS_S1 = 8.3321608736e-3f, SINCOS_S2 = -1.9515295891e-4f;
+const float SINCOS_C0 = 4.166664568298827e-2f, SINCOS_C1 = -1.388731625493765e-3f, SINCOS_C2 = 2.443315711809948e-5f;
+
+// Caminho escalar; também cobre o resto quando `count` não é múltiplo do bloco
+void computeElectronBlockScalar(const ElectronKernelInput& in, size_t base, size_t count, ElectronBlock& out) {
+    for (size_t k = 0; k < count; ++k) {
+        size_t i = base + k;
+        float x = in.phase[i];
+        int quadrant = (int)std::nearbyint(x * SINCOS_TWO_OVER_PI);
+        float j = (float)quadrant;
+        float y = ((x - j * SINCOS_DP1) - j * SINCOS_DP2) - j * SINCOS_DP3;
+        float z = y * y;
+        float sinPoly = y + y * z * (SINCOS_S0 + z * (SINCOS_S1 + z * SINCOS_S2));
+        float cosPoly = (1.0f - 0.5f * z) + z * z * (SINCOS_C0 + z * (SINCOS_C1 + z * SINCOS_C2));
+        float s = (quadrant & 1) ? cosPoly : sinPoly;
+        float c = (quadrant & 1) ? sinPoly : cosPoly;
+        if (quadrant & 2) s = -s;
+        if ((quadrant + 1) & 2) c = -c;
+
+        float r = in.radius[i];
+        for (int a = 0; a < 3; ++a) {
+            float u = in.frame[FRAME_UX + a][i], v = in.frame[FRAME_VX + a][i];
+            float axisX = u * c - v * s;
+            out.lanes[a][k] = axisX;
+            out.lanes[3 + a][k] = u * s + v * c;
+            out.lanes[6 + a][k] = in.frame[FRAME_CX + a][i] + axisX * r;
+        }
+    }
+}
+
+#if defined(ATOMO_X86)
+void computeElectronBlockSSE2(const ElectronKernelInput& in, size_t base, ElectronBlock& out) {
+    const __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    for (size_t half = 0; half < ELECTRON_BLOCK; half += 4) {
+        size_t i = base + half;
+        __m128 x = _mm_loadu_ps(in.phase + i);
+        __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(SINCOS_TWO_OVER_PI)));
+        __m128 j = _mm_cvtepi32_ps(quadrant);
+        __m128 y = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(SINCOS_DP1)));
+        y = _mm_sub_ps(y, _mm_mul_ps(j, _mm_set1_ps(SINCOS_DP2)));
+        y = _mm_sub_ps(y, _mm_mul_ps(j, _mm_set1_ps(SINCOS_DP3)));
+        __m128 z = _mm_mul_ps(y, y);
+        __m128 sinPoly = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(SINCOS_S2)), _mm_set1_ps(SINCOS_S1));
+        sinPoly = _mm_add_ps(_mm_mul_ps(z, sinPoly), _mm_set1_ps(SINCOS_S0));
+        sinPoly = _mm_add_ps(y, _mm_mul_ps(_mm_mul_ps(y, z), sinPoly));
+        __m128 cosPoly = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(SINCOS_C2)), _mm_set1_ps(SINCOS_C1));
+        cosPoly = _mm_add_ps(_mm_mul_ps(z, cosPoly), _mm_set1_ps(SINCOS_C0));
+        cosPoly = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_mul_ps(_mm_mul_ps(z, z), cosPoly));
+
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+        __m128 s = _mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly));
+        __m128 c = _mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly));
+        __m128 sinSign = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, two), two));
+        __m128 cosSign = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), two));
+        s = _mm_xor_ps(s, _mm_and_ps(sinSign, signBit));
+        c = _mm_xor_ps(c, _mm_and_ps(cosSign, signBit));
+
+        __m128 r = _mm_loadu_ps(in.radius + i);
+        for (int a = 0; a < 3; ++a) {
+            __m128 u = _mm_loadu_ps(in.frame[FRAME_UX + a] + i), v = _mm_loadu_ps(in.frame[FRAME_VX + a] + i);
+            __m128 axisX = _mm_sub_ps(_mm_mul_ps(u, c), _mm_mul_ps(v, s));
+            _mm_store_ps(out.lanes[a] + half, axisX);
+            _mm_store_ps(out.lanes[3 + a] + half, _mm_add_ps(_mm_mul_ps(u, s), _mm_mul_ps(v, c)));
+            _mm_store_ps(out.lanes[6 + a] + half, _mm_add_ps(_mm_loadu_ps(in.frame[FRAME_CX + a] + i), _mm_mul_ps(axisX, r)));
+        }
+    }
+}
+
+ATOMO_TARGET_AVX2
+void computeElectronBlockAVX2(const ElectronKernelInput& in, size_t base, ElectronBlock& out) {
+    const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    size_t i = base;
+    __m256 x = _mm256_loadu_ps(in.phase + i);
+    __m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(SINCOS_TWO_OVER_PI)));
+    __m256 j = _mm256_cvtepi32_ps(quadrant);
+    __m256 y = _mm256_sub_ps(x, _mm256_mul_ps(j, _mm256_set1_ps(SINCOS_DP1)));
+    y = _mm256_sub_ps(y, _mm256_mul_ps(j, _mm256_set1_ps(SINCOS_DP2)));
+    y = _mm256_sub_ps(y, _mm256_mul_ps(j, _mm256_set1_ps(SINCOS_DP3)));
+    __m256 z = _mm256_mul_ps(y, y);
+    __m256 sinPoly = _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(SINCOS_S2)), _mm256_set1_ps(SINCOS_S1));
+    sinPoly = _mm256_add_ps(_mm256_mul_ps(z, sinPoly), _mm256_set1_ps(SINCOS_S0));
+    sinPoly = _mm256_add_ps(y, _mm256_mul_ps(_mm256_mul_ps(y, z), sinPoly));
+    __m256 cosPoly = _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(SINCOS_C2)), _mm256_set1_ps(SINCOS_C1));
+    cosPoly = _mm256_add_ps(_mm256_mul_ps(z, cosPoly), _mm256_set1_ps(SINCOS_C0));
+    cosPoly = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), z)),
+                            _mm256_mul_ps(_mm256_mul_ps(z, z), cosPoly));
+
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+    __m256 s = _mm256_blendv_ps(sinPoly, cosPoly, swap);
+    __m256 c = _mm256_blendv_ps(cosPoly, sinPoly, swap);
+    __m256 sinSign = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, two), two));
+    __m256 cosSign = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), two));
+    s = _mm256_xor_ps(s, _mm256_and_ps(sinSign, signBit));
+    c = _mm256_xor_ps(c, _mm256_and_ps(cosSign, signBit));
+
+    __m256 r = _mm256_loadu_ps(in.radius + i);
+    for (int a = 0; a < 3; ++a) {
+        __m256 u = _mm256_loadu_ps(in.frame[FRAME_UX + a] + i), v = _mm256_loadu_ps(in.frame[FRAME_VX + a] + i);
+        __m256 axisX = _mm256_sub_ps(_mm256_mul_ps(u, c), _mm256_mul_ps(v, s));
+        _mm256_store_ps(out.lanes[a], axisX);
+        _mm256_store_ps(out.lanes[3 + a], _mm256_add_ps(_mm256_mul_ps(u, s), _mm256_mul_ps(v, c)));
+        _mm256_store_ps(out.lanes[6 + a], _mm256_add_ps(_mm256_loadu_ps(in.frame[FRAME_CX + a] + i), _mm256_mul_ps(axisX, r)));
+    }
+}
+#endif
+
+SimdLevel activeSimdLevel = detectSimdLevel();
+
+// Percorre [begin, end) em blocos, calculando cada bloco no nível pedido e entregando-o a `store`
+template <typename Store>
+void runElectronKernel(const ElectronKernelInput& in, size_t begin, size_t end, SimdLevel level, Store store) {
+    ElectronBlock block;
+    size_t i = begin;
+#if defined(ATOMO_X86)
+    if (level != SimdLevel::Scalar) {
+        for (; i + ELECTRON_BLOCK <= end; i += ELECTRON_BLOCK) {
+            if (level == SimdLevel::AVX2) computeElectronBlockAVX2(in, i, block);
+            else computeElectronBlockSSE2(in, i, block);
+            store(i, ELECTRON_BLOCK, block);
+        }
+    }
+#endif
+    for (; i < end; i += ELECTRON_BLOCK) {
+        size_t count = std::min(ELECTRON_BLOCK, end - i);
+        computeElectronBlockScalar(in, i, count, block);
+        store(i, count, block);
+    }
+}
+
+// Matrizes de modelo (e cores) dos elétrons [begin, end); out[k] recebe o elétron begin + k
+void transformElectrons(const ElectronKernelInput& in, size_t begin, size_t end, float scale, const glm::vec3* palette,
+                        ElectronInstance* out, SimdLevel level = activeSimdLevel) {
+    runElectronKernel(in, begin, end, level, [&](size_t base, size_t count, const ElectronBlock& b) {
+        for (size_t k = 0; k < count; ++k) {
+            size_t i = base + k;
+            ElectronInstance& e = out[i - begin];
+            e.model[0] = glm::vec4(b.lanes[0][k] * scale, b.lanes[1][k] * scale, b.lanes[2][k] * scale, 0.0f);
+            e.model[1] = glm::vec4(in.frame[FRAME_NX][i] * scale, in.frame[FRAME_NY][i] * scale, in.frame[FRAME_NZ][i] * scale, 0.0f);
+            e.model[2] = glm::vec4(b.lanes[3][k] * scale, b.lanes[4][k] * scale, b.lanes[5][k] * scale, 0.0f);
+            e.model[3] = glm::vec4(b.lanes[6][k], b.lanes[7][k], b.lanes[8][k], 1.0f);
+            e.color = palette[in.colorIndex[i]];
+        }
+    });
+}
+
+// Cor em RGBA8 para as instâncias compactas
+uint32_t packColor(const glm::vec3& color) {
+    auto channel = [](float v) { return (uint32_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+    return channel(color.x) | (channel(color.y) << 8) | (channel(color.z) << 16) | (255u << 24);
+}
+
+// Só posição + escala e cor, sem a rotação da esfera
+void transformElectronsCompact(const ElectronKernelInput& in, size_t begin, size_t end, float scale, const uint32_t* packedPalette,
+                               CompactInstance* out, SimdLevel level = activeSimdLevel) {
+    runElectronKernel(in, begin, end, level, [&](size_t base, size_t count, const ElectronBlock& b) {
+        for (size_t k = 0; k < count; ++k) {
+            size_t i = base + k;
+            CompactInstance& e = out[i - begin];
+            e.position = glm::vec3(b.lanes[6][k], b.lanes[7][k], b.lanes[8][k]);
+            e.scale = scale;
+            e.color = packedPalette[in.colorIndex[i]];
+        }
+    });
+}
+
+// Átomos e elétrons em estrutura de arrays: cada campo fica contíguo e a atualização
+// percorre os arrays em ordem. Reservados de uma vez, sem alocação por elétron.
+struct AtomArrays {
+    std::vector<glm::vec3> position;
+    std::vector<uint8_t> element;           // número atômico (0 = modelo clássico de 5 elétrons)
+    std::vector<float> nucleusRadius;
+    std::vector<uint32_t> firstElectron;
+    std::vector<uint32_t> electronCount;
+};
+
+struct ElectronArrays {
+    std::vector<uint32_t> atom;             // átomo dono (centro da órbita)
+    std::vector<float> orbitRadius;
+    std::vector<glm::quat> plane;           // gira a órbita base (plano XZ) para o plano do elétron
+    std::vector<float> phase;               // estado atual (buffer da frente)
+    std::vector<float> nextPhase;           // próximo passo (buffer de trás), trocado em swapState
+    std::vector<float> angularSpeed;        // rad/s
+    std::vector<uint8_t> colorIndex;
+    std::vector<float> frame[FRAME_FIELDS]; // base do plano e centro, calculados uma vez para o kernel
+};
+
+// Tamanho dos elétrons (a esfera base tem raio 1)
+const float ELECTRON_SCALE = 0.2f;
+
+class Scene {
+public:
+    AtomArrays atoms;
+    ElectronArrays electrons;
+
+    void reserve(size_t atomCount, size_t electronCount) {
+        atoms.position.reserve(atomCount);
+        atoms.element.reserve(atomCount);
+        atoms.nucleusRadius.reserve(atomCount);
+        atoms.firstElectron.reserve(atomCount);
+        atoms.electronCount.reserve(atomCount);
+        electrons.atom.reserve(electronCount);
+        electrons.orbitRadius.reserve(electronCount);
+        electrons.plane.reserve(electronCount);
+        electrons.phase.reserve(electronCount);
+        electrons.nextPhase.reserve(electronCount);
+        electrons.angularSpeed.reserve(electronCount);
+        electrons.colorIndex.reserve(electronCount);
+        for (std::vector<float>& field : electrons.frame) field.reserve(electronCount);
+    }
+
+    size_t atomCount() const { return atoms.position.size(); }
+    size_t electronCount() const { return electrons.phase.size(); }
+
+    // O modelo original: cinco elétrons a raio 2, nos planos horizontal, vertical e diagonais
+    void addClassicAtom(const glm::vec3& position) {
+        const glm::vec3 X(1, 0, 0), Y(0, 1, 0), Z(0, 0, 1);
+        const glm::quat planes[] = {
+            glm::quat(1, 0, 0, 0),                                   // horizontal (XZ)
+            glm::quat_cast(glm::mat4(glm::mat3(Z, X, Y))),          // vertical (YZ), começando em +Z
+            glm::angleAxis(glm::radians(45.0f), X) * glm::angleAxis(glm::radians(45.0f), Y),
+            glm::angleAxis(glm::radians(45.0f), X) * glm::angleAxis(glm::radians(45.0f), Z),
+            glm::angleAxis(glm::radians(-45.0f), X) * glm::angleAxis(glm::radians(-45.0f), Z),
+        };
+        uint32_t atom = addNucleus(position, 0, 0.5f);
+        for (const glm::quat& plane : planes)
+            addElectron(atom, 2.0f, plane, 0.0f, 1.0f, 0);
+    }
+
+    // Átomo de número atômico z: um elétron por órbita, raio crescendo com a camada (n)
+    // e, dentro dela, com o subnível (l). Os planos se espalham numa espiral de Fibonacci.
+    void addAtom(const Element& element, unsigned int z, const glm::vec3& position) {
+        uint32_t atom = addNucleus(position, (uint8_t)z, 0.35f + 0.08f * std::cbrt((float)z));
+        unsigned int index = 0;
+        for (const Subshell& subshell : element.subshells) {
+            float radius = shellRadius(subshell.n) + 0.15f * subshell.l;
+            float speed = 1.5f / subshell.n;
+            for (unsigned int k = 0; k < subshell.electrons; ++k, ++index) {
+                // Normal do plano na espiral de Fibonacci, e uma defasagem pelo ângulo áureo
+                float y = 1.0f - 2.0f * (index + 0.5f) / z;
+                float ring = std::sqrt(std::max(0.0f, 1.0f - y * y));
+                float theta = 2.39996323f * index;
+                glm::vec3 normal(ring * std::cos(theta), y, ring * std::sin(theta));
+                addElectron(atom, radius, rotationFromY(normal), theta, speed, subshell.l);
+            }
+        }
+    }
+
+    // Átomo sem elétrons; os elétrons dele devem ser adicionados em seguida, antes do próximo átomo
+    uint32_t addNucleus(const glm::vec3& position, uint8_t element, float nucleusRadius) {
+        atoms.position.push_back(position);
+        atoms.element.push_back(element);
+        atoms.nucleusRadius.push_back(nucleusRadius);
+        atoms.firstElectron.push_back((uint32_t)electronCount());
+        atoms.electronCount.push_back(0);
+        return (uint32_t)atomCount() - 1;
+    }
+
+    // Elétron na órbita de raio `radius` do átomo `atom`, no plano XZ girado por `plane`
+    void addElectron(uint32_t atom, float radius, const glm::quat& plane, float phase, float speed, uint8_t colorIndex) {
+        electrons.atom.push_back(atom);
+        electrons.orbitRadius.push_back(radius);
+        electrons.plane.push_back(plane);
+        electrons.phase.push_back(phase);
+        electrons.nextPhase.push_back(phase);
+        electrons.angularSpeed.push_back(speed);
+        electrons.colorIndex.push_back(colorIndex);
+        glm::mat3 basis = glm::mat3_cast(plane);
+        const glm::vec3& center = atoms.position[atom];
+        for (int a = 0; a < 3; ++a) {
+            electrons.frame[FRAME_UX + a].push_back(basis[0][a]);
+            electrons.frame[FRAME_NX + a].push_back(basis[1][a]);
+            electrons.frame[FRAME_VX + a].push_back(basis[2][a]);
+            electrons.frame[FRAME_CX + a].push_back(center[a]);
+        }
+        ++atoms.electronCount[atom];
+    }
+
+    // Rotação que leva o eixo Y (normal da órbita base) até `normal`
+    static glm::quat rotationFromY(const glm::vec3& normal) {
+        const glm::vec3 up(0.0f, 1.0f, 0.0f);
+        float d = glm::dot(up, normal);
+        if (d > 0.9999f) return glm::quat(1, 0, 0, 0);
+        if (d < -0.9999f) return glm::angleAxis(glm::radians(180.0f), glm::vec3(1, 0, 0));
+        return glm::angleAxis(std::acos(d), glm::normalize(glm::cross(up, normal)));
+    }
+
+    // Raio da camada n
+    static float shellRadius(unsigned int n) { return 1.5f + 1.0f * (n - 1); }
+
+    // Instâncias fixas dos núcleos no começo de `instances`; os elétrons ficam logo depois
+    void prepareInstances(std::vector<ElectronInstance>& instances) const {
+        instances.resize(atomCount() + electronCount());
+        for (size_t a = 0; a < atomCount(); ++a) {
+            instances[a].model = glm::scale(glm::translate(glm::mat4(1.0f), atoms.position[a]), glm::vec3(atoms.nucleusRadius[a]));
+            instances[a].color = glm::vec3(0.0f, 0.0f, 1.0f); // azul
+        }
+    }
+
+    // Avança os elétrons [begin, end) em dt e monta as matrizes deles em electronInstances[begin, end).
+    // Lê só o buffer da frente e escreve só no de trás, então trechos disjuntos podem rodar em paralelo
+    // (e o resultado não depende de como o trabalho foi dividido).
+    void stepRange(size_t begin, size_t end, float dt, ElectronInstance* electronInstances) {
+        const float* phase = electrons.phase.data();
+        const float* speed = electrons.angularSpeed.data();
+        float* next = electrons.nextPhase.data();
+        const float twoPi = 6.28318530718f;
+        for (size_t i = begin; i < end; ++i) {
+            next[i] = phase[i] + speed[i] * dt;
+            if (next[i] > twoPi) next[i] -= twoPi;
+        }
+        ElectronKernelInput in = kernelInput();
+        in.phase = next;
+        transformElectrons(in, begin, end, ELECTRON_SCALE, ELECTRON_COLORS, electronInstances + begin);
+    }
+
+    // Fim do passo: o buffer de trás vira o estado atual
+    void swapState() { electrons.phase.swap(electrons.nextPhase); }
+
+    // Passo completo numa só thread
+    void step(float dt, std::vector<ElectronInstance>& instances) {
+        if (instances.size() != atomCount() + electronCount()) prepareInstances(instances);
+        stepRange(0, electronCount(), dt, instances.data() + atomCount());
+        swapState();
+    }
+
+    ElectronKernelInput kernelInput() const {
+        ElectronKernelInput in;
+        for (int f = 0; f < FRAME_FIELDS; ++f) in.frame[f] = electrons.frame[f].data();
+        in.phase = electrons.phase.data();
+        in.radius = electrons.orbitRadius.data();
+        in.colorIndex = electrons.colorIndex.data();
+        in.count = electronCount();
+        return in;
+    }
+
+    void buildOrbits(OrbitRenderer& orbitRenderer) const {
+        orbitRenderer.clear();
+        for (size_t i = 0; i < electronCount(); ++i) {
+            orbitRenderer.addOrbit(atoms.position[electrons.atom[i]], electrons.orbitRadius[i], electrons.plane[i],
+                                   ORBIT_COLORS[electrons.colorIndex[i]]);
+        }
+    }
+
+    // Centro e raio de uma esfera que envolve todos os átomos com suas órbitas
+    void bounds(glm::vec3& center, float& radius) const {
+        center = glm::vec3(0.0f);
+        radius = 1.0f;
+        if (atoms.position.empty()) return;
+        for (const glm::vec3& p : atoms.position) center += p;
+        center /= (float)atomCount();
+        for (size_t a = 0; a < atomCount(); ++a)
+            radius = std::max(radius, glm::length(atoms.position[a] - center) + atomRadius(a));
+    }
+
+    // Raio da esfera que envolve o núcleo e a órbita mais externa do átomo
+    float atomRadius(size_t atom) const {
+        float outer = atoms.nucleusRadius[atom];
+        for (uint32_t i = 0; i < atoms.electronCount[atom]; ++i)
+            outer = std::max(outer, electrons.orbitRadius[atoms.firstElectron[atom] + i] + ELECTRON_SCALE);
+        return outer;
+    }
+};
+
+// Lê átomos no formato XYZ (contagem, comentário, "Símbolo x y z" em angstrom) e monta a cena.
+// As distâncias são ampliadas para que as órbitas de átomos vizinhos não se sobreponham demais.
+bool loadXYZ(std::istream& in, const ElementTable& table, Scene& scene, std::ostream& errors) {
+    const float ANGSTROM_SCALE = 4.0f;
+    size_t count = 0;
+    std::string line;
+    if (!(in >> count) || !std::getline(in, line) || !std::getline(in, line)) {
+        errors << "XYZ: cabecalho invalido\n";
+        return false;
+    }
+    std::vector<std::pair<unsigned int, glm::vec3>> parsed;
+    parsed.reserve(count);
+    size_t electronTotal = 0;
+    for (size_t i = 0; i < count; ++i) {
+        std::string symbol;
+        glm::vec3 p;
+        if (!(in >> symbol >> p.x >> p.y >> p.z)) {
+            errors << "XYZ: esperados " << count << " atomos, lidos " << i << "\n";
+            return false;
+        }
+        unsigned int z = table.find(symbol);
+        if (!z) {
+            errors << "XYZ: elemento desconhecido '" << symbol << "'\n";
+            return false;
+        }
+        parsed.push_back({ z, p * ANGSTROM_SCALE });
+        electronTotal += z;
+    }
+    scene.reserve(scene.atomCount() + parsed.size(), scene.electronCount() + electronTotal);
+    for (const auto& atom : parsed)
+        scene.addAtom(table[atom.first], atom.first, atom.second);
+    return true;
+}
+
+// ---- Índice espacial e culling ----
+
+struct BoundingBox {
+    glm::vec3 min, max;
+};
+
+// Planos do frustum (normal para dentro, w = distância), tirados de projection * view
+struct Frustum {
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4& viewProjection) {
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        for (int i = 0; i < 3; ++i) {
+            glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+            planes[2 * i] = row3 + row;
+            planes[2 * i + 1] = row3 - row;
+        }
+        for (glm::vec4& plane : planes) plane = plane / glm::length(glm::vec3(plane));
+    }
+};
+
+// Átomos por folha da BVH
+const uint32_t BVH_LEAF_SIZE = 4;
+
+// BVH sobre as esferas dos átomos (núcleo + órbita mais externa). Os filhos ficam sempre depois do pai
+// no array, então o refit é uma passada de trás para frente, sem reconstruir a árvore.
+class AtomBVH {
+public:
+    void build(const Scene& scene) {
+        updateSpheres(scene);
+        order.resize(scene.atomCount());
+        for (uint32_t a = 0; a < order.size(); ++a) order[a] = a;
+        nodes.clear();
+        nodes.reserve(2 * (order.size() / BVH_LEAF_SIZE + 1));
+        if (order.empty()) return;
+        nodes.push_back(Node());
+        split(0, 0, (uint32_t)order.size());
+        refitNodes();
+    }
+
+    // Atualiza as caixas depois que átomos se moveram (a topologia continua a mesma)
+    void refit(const Scene& scene) {
+        updateSpheres(scene);
+        refitNodes();
+    }
+
+    // Átomos cuja esfera toca o frustum. Subárvores inteiramente dentro de um plano deixam de testá-lo.
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const {
+        visible.clear();
+        if (nodes.empty()) return;
+        std::pair<uint32_t, uint32_t> stack[64];
+        int top = 0;
+        stack[top++] = { 0, 0x3Fu };
+        while (top > 0) {
+            uint32_t index = stack[top - 1].first, mask = stack[top - 1].second;
+            --top;
+            const Node& node = nodes[index];
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; ++p) {
+                if (!(mask & (1u << p))) continue;
+                const glm::vec4& plane = frustum.planes[p];
+                glm::vec3 positive(plane.x > 0 ? node.box.max.x : node.box.min.x, plane.y > 0 ? node.box.max.y : node.box.min.y,
+                                   plane.z > 0 ? node.box.max.z : node.box.min.z);
+                glm::vec3 negative(plane.x > 0 ? node.box.min.x : node.box.max.x, plane.y > 0 ? node.box.min.y : node.box.max.y,
+                                   plane.z > 0 ? node.box.min.z : node.box.max.z);
+                if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) outside = true;
+                else if (glm::dot(glm::vec3(plane), negative) + plane.w >= 0.0f) mask &= ~(1u << p);
+            }
+            if (outside) continue;
+            if (node.count == 0) {
+                stack[top++] = { node.first, mask };
+                stack[top++] = { node.first + 1, mask };
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                const glm::vec4& sphere = spheres[order[i]];
+                bool inside = true;
+                for (int p = 0; p < 6 && inside; ++p)
+                    if ((mask & (1u << p)) && glm::dot(glm::vec3(frustum.planes[p]), glm::vec3(sphere)) + frustum.planes[p].w < -sphere.w)
+                        inside = false;
+                if (inside) visible.push_back(order[i]);
+            }
+        }
+    }
+
+    const glm::vec4& sphere(uint32_t atom) const { return spheres[atom]; }
+    size_t nodeCount() const { return nodes.size(); }
+
+private:
+    // count == 0: nó interno, com os filhos em first e first + 1
+    struct Node {
+        BoundingBox box;
+        uint32_t first = 0, count = 0;
+    };
+
+    void updateSpheres(const Scene& scene) {
+        spheres.resize(scene.atomCount());
+        for (size_t a = 0; a < spheres.size(); ++a)
+            spheres[a] = glm::vec4(scene.atoms.position[a], scene.atomRadius(a));
+    }
+
+    // Divide os átomos order[first, first + count) pela mediana do eixo mais longo dos centros
+    void split(uint32_t index, uint32_t first, uint32_t count) {
+        if (count <= BVH_LEAF_SIZE) {
+            nodes[index].first = first;
+            nodes[index].count = count;
+            return;
+        }
+        glm::vec3 low(spheres[order[first]]), high = low;
+        for (uint32_t i = first + 1; i < first + count; ++i) {
+            low = glm::min(low, glm::vec3(spheres[order[i]]));
+            high = glm::max(high, glm::vec3(spheres[order[i]]));
+        }
+        glm::vec3 extent = high - low;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        uint32_t half = count / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                         [&](uint32_t a, uint32_t b) { return spheres[a][axis] < spheres[b][axis]; });
+        uint32_t children = (uint32_t)nodes.size();
+        nodes[index].first = children;
+        nodes[index].count = 0;
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        split(children, first, half);
+        split(children + 1, first + half, count - half);
+    }
+
+    void refitNodes() {
+        for (size_t n = nodes.size(); n-- > 0;) {
+            Node& node = nodes[n];
+            if (node.count == 0) {
+                node.box.min = glm::min(nodes[node.first].box.min, nodes[node.first + 1].box.min);
+                node.box.max = glm::max(nodes[node.first].box.max, nodes[node.first + 1].box.max);
+                continue;
+            }
+            node.box.min = glm::vec3(spheres[order[node.first]]) - glm::vec3(spheres[order[node.first]].w);
+            node.box.max = glm::vec3(spheres[order[node.first]]) + glm::vec3(spheres[order[node.first]].w);
+            for (uint32_t i = node.first + 1; i < node.first + node.count; ++i) {
+                const glm::vec4& s = spheres[order[i]];
+                node.box.min = glm::min(node.box.min, glm::vec3(s) - glm::vec3(s.w));
+                node.box.max = glm::max(node.box.max, glm::vec3(s) + glm::vec3(s.w));
+            }
+        }
+    }
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;      // átomos agrupados por folha
+    std::vector<glm::vec4> spheres;   // por átomo: centro e raio
+};
+
+// Níveis de detalhe da esfera (40x40, 20x20 e 10x10) e o raio projetado do núcleo, em pixels,
+// a partir do qual cada um é usado
+const unsigned int LOD_LEVELS = 3;
+const float LOD_MIN_PIXELS[LOD_LEVELS] = { 12.0f, 4.0f, 0.0f };
+
+struct CullStats {
+    unsigned int visible = 0, culled = 0;
+    double milliseconds = 0.0;
+};
+
+// Culling e escolha de nível de detalhe por átomo. Com a mesma câmera do frame anterior (e sem refit)
+// o resultado anterior é reaproveitado.
+class SceneCuller {
+public:
+    void build(const Scene& scene) {
+        bvh.build(scene);
+        valid = false;
+    }
+
+    void refit(const Scene& scene) {
+        bvh.refit(scene);
+        valid = false;
+    }
+
+    // pixelsPerUnit: pixels ocupados por uma unidade a distância 1 (altura da tela / (2 tan(fov / 2)))
+    void update(const Scene& scene, const glm::mat4& viewProjection, const glm::vec3& cameraPos, float pixelsPerUnit,
+                unsigned int lodLevels) {
+        auto start = std::chrono::steady_clock::now();
+        if (!valid || viewProjection != lastViewProjection || lodLevels != lastLodLevels) {
+            bvh.cull(Frustum(viewProjection), visible);
+            for (std::vector<uint32_t>& list : lodAtoms) list.clear();
+            for (uint32_t atom : visible) {
+                float distance = std::max(glm::length(glm::vec3(bvh.sphere(atom)) - cameraPos), 1e-3f);
+                float pixels = scene.atoms.nucleusRadius[atom] * pixelsPerUnit / distance;
+                unsigned int lod = 0;
+                while (lod + 1 < lodLevels && pixels < LOD_MIN_PIXELS[lod]) ++lod;
+                lodAtoms[lod].push_back(atom);
+            }
+            lastViewProjection = viewProjection;
+            lastLodLevels = lodLevels;
+            valid = true;
+        }
+        stats.visible = (unsigned int)visible.size();
+        stats.culled = (unsigned int)(scene.atomCount() - visible.size());
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const std::vector<uint32_t>& atomsAtLod(unsigned int lod) const { return lodAtoms[lod]; }
+
+    CullStats stats;
+
+private:
+    AtomBVH bvh;
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> lodAtoms[LOD_LEVELS];
+    glm::mat4 lastViewProjection;
+    unsigned int lastLodLevels = 0;
+    bool valid = false;
+};
+
+// Instâncias (núcleo e elétrons) dos átomos da lista
+size_t countAtomInstances(const Scene& scene, const std::vector<uint32_t>& atomList) {
+    size_t count = atomList.size();
+    for (uint32_t atom : atomList) count += scene.atoms.electronCount[atom];
+    return count;
+}
+
+// Junta as instâncias dos átomos da lista em `out` (com espaço para countAtomInstances), copiando os
+// trechos contíguos de cada um; devolve o fim do que foi escrito
+ElectronInstance* gatherAtomInstances(const Scene& scene, const std::vector<ElectronInstance>& instances,
+                                      const std::vector<uint32_t>& atomList, ElectronInstance* out) {
+    for (uint32_t atom : atomList) {
+        *out++ = instances[atom];
+        const ElectronInstance* first = instances.data() + scene.atomCount() + scene.atoms.firstElectron[atom];
+        out = std::copy(first, first + scene.atoms.electronCount[atom], out);
+    }
+    return out;
+}
+
+// Como gatherAtomInstances, com a posição de cada elétron interpolada entre dois passos da simulação
+// (alpha 0 = previous, 1 = current); o núcleo e o resto da matriz vêm do passo atual
+ElectronInstance* gatherInterpolatedInstances(const Scene& scene, const std::vector<ElectronInstance>& previous,
+                                              const std::vector<ElectronInstance>& current, float alpha,
+                                              const std::vector<uint32_t>& atomList, ElectronInstance* out) {
+    for (uint32_t atom : atomList) {
+        *out++ = current[atom];
+        size_t first = scene.atomCount() + scene.atoms.firstElectron[atom], last = first + scene.atoms.electronCount[atom];
+        for (size_t i = first; i < last; ++i) {
+            ElectronInstance instance = current[i];
+            instance.model[3] = glm::mix(previous[i].model[3], current[i].model[3], alpha);
+            *out++ = instance;
+        }
+    }
+    return out;
+}
+
+// Rede cristalina do tipo sal-gema (NaCl): n x n x n átomos alternando sódio e cloro
+bool addRockSaltLattice(const ElementTable& table, unsigned int n, Scene& scene) {
+    const float spacing = 2.82f * 4.0f; // distância Na-Cl em angstrom, na mesma escala de loadXYZ
+    unsigned int sodium = table.find("Na"), chlorine = table.find("Cl");
+    if (!sodium || !chlorine || n == 0) return false;
+    size_t atomCount = (size_t)n * n * n;
+    scene.reserve(scene.atomCount() + atomCount, scene.electronCount() + (atomCount + 1) / 2 * sodium + atomCount / 2 * chlorine);
+    float offset = (n - 1) * spacing * 0.5f;
+    for (unsigned int x = 0; x < n; ++x)
+        for (unsigned int y = 0; y < n; ++y)
+            for (unsigned int z = 0; z < n; ++z) {
+                unsigned int element = (x + y + z) % 2 == 0 ? sodium : chlorine;
+                glm::vec3 position = glm::vec3((float)x, (float)y, (float)z) * spacing - glm::vec3(offset);
+                scene.addAtom(table[element], element, position);
+            }
+    return true;
+}
+
+// Confere o culling da BVH contra o teste de todas as esferas, com câmeras dentro e fora da rede,
+// antes e depois de mover os átomos (refit), e compara os tempos
+int runCullingBenchmark(const ElementTable& table, unsigned int latticeSize) {
+    Scene scene;
+    addRockSaltLattice(table, latticeSize, scene);
+    glm::vec3 center;
+    float radius;
+    scene.bounds(center, radius);
+    std::cout << "Rede " << latticeSize << "^3: " << scene.atomCount() << " atomos" << std::endl;
+
+    auto bruteForce = [&](const Frustum& frustum, std::vector<uint32_t>& visible) {
+        visible.clear();
+        for (uint32_t a = 0; a < scene.atomCount(); ++a) {
+            glm::vec3 position = scene.atoms.position[a];
+            float r = scene.atomRadius(a);
+            bool inside = true;
+            for (const glm::vec4& plane : frustum.planes)
+                if (glm::dot(glm::vec3(plane), position) + plane.w < -r) inside = false;
+            if (inside) visible.push_back(a);
+        }
+    };
+
+    auto buildStart = std::chrono::steady_clock::now();
+    AtomBVH bvh;
+    bvh.build(scene);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+    std::cout << "BVH: " << bvh.nodeCount() << " nos, construida em " << buildMs << " ms" << std::endl;
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(SCR_WIDTH) / SCR_HEIGHT, 0.1f, 4.0f * radius);
+    bool ok = true;
+    std::vector<uint32_t> visible, expected;
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            // Desloca todos os átomos e atualiza só as caixas
+            for (size_t a = 0; a < scene.atomCount(); ++a)
+                scene.atoms.position[a] += glm::vec3(std::sin(a * 0.7f), std::cos(a * 1.3f), std::sin(a * 2.1f)) * 3.0f;
+            auto refitStart = std::chrono::steady_clock::now();
+            bvh.refit(scene);
+            double refitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - refitStart).count();
+            std::cout << "Atomos deslocados, refit em " << refitMs << " ms" << std::endl;
+        }
+        std::cout << "camera\t\tvisiveis\tcortados\tBVH (ms)\ttodas (ms)\tconfere" << std::endl;
+        for (int view = 0; view < 6; ++view) {
+            // Órbita em volta da rede: longe (tudo visível), na borda e dentro dela
+            float distance = radius * (view < 2 ? 2.5f : view < 4 ? 0.8f : 0.2f);
+            float yawAngle = glm::radians(37.0f + 61.0f * view), pitchAngle = glm::radians(-20.0f + 9.0f * view);
+            glm::vec3 eye = center + distance * glm::vec3(std::cos(pitchAngle) * std::cos(yawAngle), std::sin(pitchAngle),
+                                                         std::cos(pitchAngle) * std::sin(yawAngle));
+            Frustum frustum(projection * glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+            const int repeats = 20;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; ++r) bvh.cull(frustum, visible);
+            double bvhMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+            start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; ++r) bruteForce(frustum, expected);
+            double bruteMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+
+            std::sort(visible.begin(), visible.end());
+            bool same = visible == expected;
+            ok = ok && same;
+            std::cout << distance << "\t\t" << visible.size() << "\t\t" << scene.atomCount() - visible.size() << "\t\t"
+                      << bvhMs << "\t\t" << bruteMs << "\t\t" << (same ? "sim" : "NAO") << std::endl;
+        }
+    }
+    std::cout << (ok ? "Culling da BVH igual ao teste de todas as esferas" : "Culling da BVH DIFERENTE do teste de todas as esferas")
+              << std::endl;
+    return ok ? 0 : 1;
+}
+
+// ---- Sistema de tarefas ----
+
+// Cada thread tem sua própria fila (deque) de pedaços de trabalho. A dona tira pelo começo, na ordem
+// da memória; quem fica sem trabalho rouba do fim da fila de outra thread. A thread que chama wait()
+// também trabalha, então JobSystem(1) roda tudo em série, sem threads extras.
+class JobSystem {
+public:
+    typedef void (*JobFunction)(void* body, size_t begin, size_t end);
+
+    // Pedaços ainda não terminados de um ou mais parallelFor
+    struct Group {
+        std::atomic<size_t> pending{ 0 };
+    };
+
+    explicit JobSystem(unsigned int threads) : queues(std::max(1u, threads)) {
+        for (std::unique_ptr<WorkerQueue>& queue : queues) queue.reset(new WorkerQueue);
+        for (unsigned int i = 1; i < queues.size(); ++i) workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    unsigned int threadCount() const { return (unsigned int)queues.size(); }
+    uint64_t stealCount() const { return steals.load(); }
+
+    // Divide [0, count) em pedaços de `chunk` e chama body(begin, end) em cada um, sem esperar.
+    // Cada fila recebe uma faixa contígua de pedaços. `body` precisa existir até wait(group) voltar.
+    template <typename Body>
+    void parallelFor(Group& group, size_t count, size_t chunk, Body& body) {
+        if (count == 0) return;
+        JobFunction function = [](void* b, size_t begin, size_t end) { (*static_cast<Body*>(b))(begin, end); };
+        size_t jobCount = (count + chunk - 1) / chunk;
+        group.pending += jobCount;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued += jobCount;
+        }
+        for (size_t q = 0; q < queues.size(); ++q) {
+            size_t first = jobCount * q / queues.size(), last = jobCount * (q + 1) / queues.size();
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            for (size_t j = first; j < last; ++j)
+                queues[q]->jobs.push_back({ function, &body, j * chunk, std::min(count, (j + 1) * chunk), &group });
+        }
+        wake.notify_all();
+    }
+
+    // Trabalha (na fila da thread chamadora, depois roubando) até o grupo terminar
+    void wait(Group& group) {
+        Job job;
+        while (group.pending.load(std::memory_order_acquire) > 0) {
+            if (takeJob(0, job)) execute(job);
+            else std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Job {
+        JobFunction function;
+        void* body;
+        size_t begin, end;
+        Group* group;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    bool takeJob(unsigned int self, Job& job) {
+        {
+            WorkerQueue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = own.jobs.front();
+                own.jobs.pop_front();
+                --queued;
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); ++k) {
+            WorkerQueue& victim = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.back();
+                victim.jobs.pop_back();
+                --queued;
+                ++steals;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(const Job& job) {
+        job.function(job.body, job.begin, job.end);
+        job.group->pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    void workerLoop(unsigned int index) {
+        Job job;
+        for (;;) {
+            if (takeJob(index, job)) {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues; // [0] é a thread que chama wait()
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{ 0 };
+    std::atomic<uint64_t> steals{ 0 };
+    bool stopping = false;
+};
+
+// Elétrons por pedaço: ~130 KB de entrada e saída (fases, bases, matrizes), cabe no L2
+const size_t STEP_CHUNK = 1024;
+
+// Um passo da cena como corpo de parallelFor
+struct SceneStep {
+    Scene* scene;
+    float dt;
+    ElectronInstance* electronInstances;
+
+    void operator()(size_t begin, size_t end) const { scene->stepRange(begin, end, dt, electronInstances); }
+};
+
+// Passo fixo da simulação com janela (sem janela o passo é 1 / --fps). Um frame consome no máximo
+// MAX_STEPS_PER_FRAME passos: depois de um frame muito lento a simulação perde tempo em vez de gastar
+// os frames seguintes alcançando o relógio.
+const float SIMULATION_STEP = 1.0f / 60.0f;
+const unsigned int MAX_STEPS_PER_FRAME = 8;
+
+// Dispara o passo da cena nas threads e volta sem esperar; depois de jobs.wait(group), chamar scene.swapState()
+void launchSceneStep(JobSystem& jobs, JobSystem::Group& group, SceneStep& step, Scene& scene, float dt,
+                     std::vector<ElectronInstance>& instances) {
+    if (instances.size() != scene.atomCount() + scene.electronCount()) scene.prepareInstances(instances);
+    step = { &scene, dt, instances.data() + scene.atomCount() };
+    jobs.parallelFor(group, scene.electronCount(), STEP_CHUNK, step);
+}
+
+// Tempo do passo da rede com 1..maxThreads threads, conferindo que o resultado é idêntico ao da versão em série
+int runThreadBenchmark(const ElementTable& table, unsigned int latticeSize, unsigned int maxThreads) {
+    const int frames = 20;
+    const float dt = 1.0f / 60.0f;
+    Scene scene;
+    addRockSaltLattice(table, latticeSize, scene);
+    std::cout << "Rede " << latticeSize << "^3: " << scene.atomCount() << " atomos, " << scene.electronCount()
+              << " eletrons, pedacos de " << STEP_CHUNK << " eletrons" << std::endl;
+    const std::vector<float> initialPhase = scene.electrons.phase;
+
+    // Referência em série
+    std::vector<ElectronInstance> reference;
+    for (int f = 0; f < frames; ++f) scene.step(dt, reference);
+    const std::vector<float> referencePhase = scene.electrons.phase;
+
+    std::cout << "threads\tms/passo\tspeedup\teficiencia\troubos/passo\tidentico" << std::endl;
+    double singleMs = 0.0;
+    bool deterministic = true;
+    std::vector<ElectronInstance> instances;
+    for (unsigned int threads = 1; threads <= maxThreads; ++threads) {
+        scene.electrons.phase = initialPhase;
+        instances.clear();
+        JobSystem jobs(threads);
+        JobSystem::Group group;
+        SceneStep step;
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f) {
+            launchSceneStep(jobs, group, step, scene, dt, instances);
+            jobs.wait(group);
+            scene.swapState();
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+        if (threads == 1) singleMs = ms;
+        bool identical = scene.electrons.phase == referencePhase &&
+                         std::memcmp(instances.data(), reference.data(), reference.size() * sizeof(ElectronInstance)) == 0;
+        deterministic = deterministic && identical;
+        std::cout << threads << "\t" << ms << "\t\t" << singleMs / ms << "\t" << singleMs / ms / threads << "\t\t"
+                  << jobs.stealCount() / frames << "\t\t" << (identical ? "sim" : "NAO") << std::endl;
+    }
+    std::cout << (deterministic ? "Resultado identico ao da versao em serie com qualquer numero de threads"
+                                : "Resultado DIFERENTE da versao em serie") << std::endl;
+    return deterministic ? 0 : 1;
+}
+
+// Compara o kernel em lote com a cadeia de matrizes do glm (translate * plano * rotate * translate * scale)
+// para 1k, 100k e 1M elétrons, em cada nível de SIMD suportado. Antes confere as matrizes contra o glm.
+int runSimdBenchmark() {
+    const size_t counts[] = { 1000, 100000, 1000000 };
+    const float tolerance = 1e-5f; // erro relativo (absoluto abaixo de 1)
+    std::vector<SimdLevel> levels = { SimdLevel::Scalar };
+#if defined(ATOMO_X86)
+    levels.push_back(SimdLevel::SSE2);
+    if (detectSimdLevel() == SimdLevel::AVX2) levels.push_back(SimdLevel::AVX2);
+#endif
+    uint32_t packedPalette[4];
+    for (int c = 0; c < 4; ++c) packedPalette[c] = packColor(ELECTRON_COLORS[c]);
+
+    std::cout << "Kernel de eletrons (SIMD detectado: " << simdLevelName(detectSimdLevel()) << ")" << std::endl;
+    bool ok = true;
+    for (size_t count : counts) {
+        // Átomos de 100 elétrons numa grade, com fases espalhadas em [-50, 50] para exercitar a redução
+        Scene scene;
+        scene.reserve(count / 100 + 1, count);
+        uint32_t atom = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (i % 100 == 0)
+                atom = scene.addNucleus(glm::vec3(float(i / 100 % 100), float(i / 10000), 0.0f) * 20.0f, 0, 0.5f);
+            float y = 1.0f - 2.0f * ((i % 100) + 0.5f) / 100.0f;
+            float ring = std::sqrt(std::max(0.0f, 1.0f - y * y));
+            float theta = 2.39996323f * i;
+            glm::vec3 normal(ring * std::cos(theta), y, ring * std::sin(theta));
+            float phase = std::fmod(theta * 0.618034f, 100.0f) - 50.0f;
+            scene.addElectron(atom, 1.5f + float(i % 7), Scene::rotationFromY(normal), phase, 1.0f, uint8_t(i % 4));
+        }
+        ElectronKernelInput in = scene.kernelInput();
+        size_t repeats = std::max<size_t>(3, 2000000 / count);
+
+        // Referência: a cadeia de matrizes do glm
+        std::vector<ElectronInstance> reference(count);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < repeats; ++r) {
+            for (size_t i = 0; i < count; ++i) {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), scene.atoms.position[scene.electrons.atom[i]]);
+                model = model * glm::mat4_cast(scene.electrons.plane[i]);
+                model = glm::rotate(model, scene.electrons.phase[i], glm::vec3(0, 1, 0));
+                model = glm::translate(model, glm::vec3(scene.electrons.orbitRadius[i], 0.0f, 0.0f));
+                reference[i].model = glm::scale(model, glm::vec3(ELECTRON_SCALE));
+                reference[i].color = ELECTRON_COLORS[scene.electrons.colorIndex[i]];
+            }
+        }
+        double glmMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+        std::cout << count << " eletrons: glm " << glmMs << " ms" << std::endl;
+
+        std::vector<ElectronInstance> models(count);
+        std::vector<ElectronInstance> firstLevel;
+        std::vector<CompactInstance> compact(count);
+        for (SimdLevel level : levels) {
+            start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < repeats; ++r)
+                transformElectrons(in, 0, count, ELECTRON_SCALE, ELECTRON_COLORS, models.data(), level);
+            double matrixMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+            start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < repeats; ++r)
+                transformElectronsCompact(in, 0, count, ELECTRON_SCALE, packedPalette, compact.data(), level);
+            double compactMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+
+            // Conferência: matrizes dentro da tolerância do glm, posições compactas iguais às das matrizes
+            // e o mesmo resultado bit a bit em todos os níveis
+            float maxError = 0.0f;
+            bool compactMatches = true;
+            for (size_t i = 0; i < count; ++i) {
+                for (int c = 0; c < 4; ++c)
+                    for (int r = 0; r < 4; ++r)
+                        maxError = std::max(maxError, std::fabs(models[i].model[c][r] - reference[i].model[c][r]) /
+                                                       std::max(1.0f, std::fabs(reference[i].model[c][r])));
+                if (compact[i].position != glm::vec3(models[i].model[3]) ||
+                    compact[i].color != packColor(models[i].color))
+                    compactMatches = false;
+            }
+            bool sameAsScalar = true;
+            if (firstLevel.empty()) firstLevel = models;
+            else sameAsScalar = std::memcmp(firstLevel.data(), models.data(), count * sizeof(ElectronInstance)) == 0;
+            bool levelOk = maxError <= tolerance && compactMatches && sameAsScalar;
+            ok = ok && levelOk;
+
+            std::cout << "  " << simdLevelName(level) << ": matrizes " << matrixMs << " ms (" << glmMs / matrixMs
+                      << "x), compactas " << compactMs << " ms (" << glmMs / compactMs << "x), erro relativo max " << maxError
+                      << (sameAsScalar ? "" : ", DIFERENTE do escalar") << (compactMatches ? "" : ", compactas erradas")
+                      << (levelOk ? "" : " FALHOU") << std::endl;
+        }
+    }
+    std::cout << (ok ? "Kernel confere com o glm (tolerancia " : "Kernel NAO confere com o glm (tolerancia ")
+              << tolerance << ")" << std::endl;
+    return ok ? 0 : 1;
+}
+
+// ---- Nuvens de probabilidade dos orbitais ----
+
+// Gerador PCG32 (O'Neill): estado de 64 bits e uma sequência independente para cada valor de `stream`
+struct Pcg32 {
+    uint64_t state = 0, increment;
+
+    Pcg32(uint64_t seed, uint64_t stream) : increment((stream << 1) | 1) {
+        next();
+        state += seed;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rot = uint32_t(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    // Uniforme em [0, 1)
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// Orbital hidrogenoide (um elétron, carga nuclear Z) e quantos pontos amostrar dele
+struct OrbitalKey {
+    unsigned int z, n;
+    int l, m;
+    size_t count;
+
+    bool operator==(const OrbitalKey& o) const { return z == o.z && n == o.n && l == o.l && m == o.m && count == o.count; }
+};
+
+// "n,l,m" com 0 <= l < n e |m| <= l
+bool parseOrbital(const std::string& text, OrbitalKey& key) {
+    int n = 0, l = -1, m = 0;
+    if (std::sscanf(text.c_str(), "%d,%d,%d", &n, &l, &m) != 3 || n < 1 || l < 0 || l >= n || std::abs(m) > l) return false;
+    key.n = (unsigned int)n;
+    key.l = l;
+    key.m = m;
+    return true;
+}
+
+// Nome espectroscópico: 1s, 2p(m=-1), 3d(m=2)...
+std::string orbitalName(const OrbitalKey& key) {
+    std::string name = std::to_string(key.n) + "spdfghik"[std::min(key.l, 7)];
+    if (key.l > 0) name += "(m=" + std::to_string(key.m) + ")";
+    return name;
+}
+
+// Pontos por pedaço da amostragem; cada pedaço tem sua própria sequência do gerador, então a nuvem não
+// depende de quantas threads a montaram
+const size_t CLOUD_CHUNK = 16384;
+// Bins da CDF radial
+const unsigned int CLOUD_RADIAL_BINS = 4096;
+// Unidades da cena por raio de Bohr (a primeira camada do modelo de Bohr tem raio 1.5)
+const float BOHR_RADIUS_UNITS = 1.5f;
+
+// Um ponto da nuvem: posição e sinal da função de onda (a cor do lobo)
+struct CloudPoint {
+    glm::vec3 position;
+    float sign;
+};
+
+// Polinômio de Laguerre generalizado L_k^alpha(x), pela recorrência de três termos
+float laguerre(int k, float alpha, float x) {
+    float previous = 1.0f, current = 1.0f + alpha - x;
+    if (k == 0) return previous;
+    for (int i = 1; i < k; ++i) {
+        float next = ((2 * i + 1 + alpha - x) * current - (i + alpha) * previous) / (i + 1);
+        previous = current;
+        current = next;
+    }
+    return current;
+}
+
+// Função de Legendre associada P_l^m(x), m >= 0
+float legendre(int l, int m, float x) {
+    float pmm = 1.0f;
+    float s = std::sqrt(std::max(0.0f, (1.0f - x) * (1.0f + x)));
+    for (int i = 1; i <= m; ++i) pmm *= -(2 * i - 1) * s;
+    if (l == m) return pmm;
+    float pmm1 = x * (2 * m + 1) * pmm;
+    for (int ll = m + 2; ll <= l; ++ll) {
+        float pll = (x * (2 * ll - 1) * pmm1 - (ll + m - 1) * pmm) / (ll - m);
+        pmm = pmm1;
+        pmm1 = pll;
+    }
+    return pmm1;
+}
+
+// Parte angular real (sem normalização): P_l^|m|(cos θ) vezes cos(mφ) para m > 0 ou sin(|m|φ) para m < 0,
+// as combinações reais de m e -m que dão os orbitais px, py, dxy...
+float realHarmonic(int l, int m, float cosTheta, float phi) {
+    float p = legendre(l, std::abs(m), cosTheta);
+    if (m > 0) return p * std::cos(m * phi);
+    if (m < 0) return p * std::sin(-m * phi);
+    return p;
+}
+
+// Amostras de |ψ|² de um orbital: r pela inversa da CDF tabelada de r² R(r)², direção por rejeição em |Y|²
+class OrbitalSampler {
+public:
+    explicit OrbitalSampler(const OrbitalKey& orbitalKey) : key(orbitalKey) {
+        // Até onde a cauda exp(-2Zr/n) já não conta (em raios de Bohr)
+        radiusMax = key.n * (2.0f * key.n + 10.0f) / key.z;
+        cdf.resize(CLOUD_RADIAL_BINS + 1, 0.0);
+        for (unsigned int i = 1; i <= CLOUD_RADIAL_BINS; ++i) {
+            float r = (i - 0.5f) * radiusMax / CLOUD_RADIAL_BINS;
+            float radial = radialPart(r);
+            cdf[i] = cdf[i - 1] + (double)r * r * radial * radial;
+        }
+        for (double& c : cdf) c /= cdf.back();
+        // Maior |Y|² numa grade, com folga para o pico entre os pontos dela
+        for (int i = 0; i <= 90; ++i)
+            for (int j = 0; j < 180; ++j) {
+                float y = realHarmonic(key.l, key.m, std::cos(i * 3.14159265f / 90), j * 6.28318531f / 180);
+                angularMax = std::max(angularMax, y * y);
+            }
+        angularMax *= 1.05f;
+    }
+
+    // Preenche out[0, count) com a sequência `stream`; devolve quantas direções foram tentadas
+    uint64_t sample(CloudPoint* out, size_t count, uint64_t stream) const {
+        Pcg32 rng(seed(), stream);
+        uint64_t tries = 0;
+        for (size_t i = 0; i < count; ++i) {
+            float cosTheta, phi, angular;
+            do {
+                cosTheta = 2.0f * rng.uniform() - 1.0f;
+                phi = 6.28318531f * rng.uniform();
+                angular = realHarmonic(key.l, key.m, cosTheta, phi);
+                ++tries;
+            } while (rng.uniform() * angularMax > angular * angular);
+            double u = rng.uniform();
+            size_t bin = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin() - 1;
+            bin = std::min<size_t>(bin, CLOUD_RADIAL_BINS - 1);
+            double t = (u - cdf[bin]) / std::max(cdf[bin + 1] - cdf[bin], 1e-12);
+            float r = (float)((bin + t) * radiusMax / CLOUD_RADIAL_BINS);
+            float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+            // O eixo polar do orbital é o Y da cena
+            out[i].position = glm::vec3(sinTheta * std::cos(phi), cosTheta, sinTheta * std::sin(phi)) * (r * BOHR_RADIUS_UNITS);
+            out[i].sign = radialPart(r) * angular >= 0.0f ? 1.0f : -1.0f;
+        }
+        return tries;
+    }
+
+    // Raio (em unidades da cena) da esfera que contém a fração `p` da probabilidade
+    float radiusAt(double p) const {
+        size_t bin = std::lower_bound(cdf.begin(), cdf.end(), p) - cdf.begin();
+        return (float)bin * radiusMax / CLOUD_RADIAL_BINS * BOHR_RADIUS_UNITS;
+    }
+
+private:
+    // R_nl(r) sem normalização, r em raios de Bohr
+    float radialPart(float r) const {
+        float rho = 2.0f * key.z * r / key.n;
+        return std::pow(rho, (float)key.l) * std::exp(-0.5f * rho) * laguerre(key.n - key.l - 1, 2.0f * key.l + 1.0f, rho);
+    }
+
+    uint64_t seed() const { return ((uint64_t)key.z << 48) ^ ((uint64_t)key.n << 32) ^ ((uint64_t)(key.l + 16) << 16) ^ (uint64_t)(key.m + 16); }
+
+    OrbitalKey key;
+    float radiusMax, angularMax = 0.0f;
+    std::vector<double> cdf;
+};
+
+// Limite de memória das nuvens guardadas (as menos usadas recentemente saem primeiro)
+const size_t CLOUD_CACHE_BYTES = 256u << 20;
+
+// Nuvens já amostradas por (Z, n, l, m, pontos), com estatísticas de acerto e de vazão da amostragem
+class OrbitalCloudCache {
+public:
+    struct Cloud {
+        OrbitalKey key;
+        std::vector<CloudPoint> points;
+        float radius; // contém 99% da probabilidade
+        uint64_t lastUse;
+    };
+
+    const Cloud& get(const OrbitalKey& key, JobSystem& jobs) {
+        ++useCounter;
+        for (Cloud& cloud : clouds) {
+            if (cloud.key == key) {
+                ++hits;
+                lastHit = true;
+                cloud.lastUse = useCounter;
+                return cloud;
+            }
+        }
+        ++misses;
+        lastHit = false;
+        OrbitalSampler sampler(key);
+        Cloud cloud = { key, std::vector<CloudPoint>(key.count), sampler.radiusAt(0.99), useCounter };
+        std::atomic<uint64_t> tries(0);
+        auto start = std::chrono::steady_clock::now();
+        auto body = [&](size_t begin, size_t end) { tries += sampler.sample(cloud.points.data() + begin, end - begin, begin / CLOUD_CHUNK); };
+        JobSystem::Group group;
+        jobs.parallelFor(group, key.count, CLOUD_CHUNK, body);
+        jobs.wait(group);
+        lastSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        lastAcceptance = key.count ? (double)key.count / tries : 0.0;
+        sampleSeconds += lastSeconds;
+        pointsSampled += key.count;
+
+        // Abre espaço tirando as menos usadas, mas sempre guarda a nova
+        size_t bytes = key.count * sizeof(CloudPoint);
+        while (!clouds.empty() && cachedBytes + bytes > CLOUD_CACHE_BYTES) {
+            auto oldest = std::min_element(clouds.begin(), clouds.end(),
+                                           [](const Cloud& a, const Cloud& b) { return a.lastUse < b.lastUse; });
+            cachedBytes -= oldest->points.size() * sizeof(CloudPoint);
+            clouds.erase(oldest);
+            ++evictions;
+        }
+        cachedBytes += bytes;
+        clouds.push_back(std::move(cloud));
+        return clouds.back();
+    }
+
+    void report(std::ostream& out, unsigned int threads) const {
+        char line[256];
+        double rate = pointsSampled / std::max(sampleSeconds, 1e-9);
+        std::snprintf(line, sizeof(line), "Cache de nuvens: %llu acertos, %llu faltas (%.0f%% de acertos), %llu descartadas, %.1f MB; "
+                      "amostragem %.2f Mpontos/s (%.2f por thread)",
+                      (unsigned long long)hits, (unsigned long long)misses, 100.0 * hits / std::max<uint64_t>(1, hits + misses),
+                      (unsigned long long)evictions, cachedBytes / 1048576.0, rate * 1e-6, rate * 1e-6 / threads);
+        out << line << std::endl;
+    }
+
+    bool lastHit = false;
+    double lastSeconds = 0.0, lastAcceptance = 0.0; // da última nuvem amostrada
+
+private:
+    std::deque<Cloud> clouds; // deque: a referência devolvida continua válida quando outra entra no fim
+    size_t cachedBytes = 0;
+    uint64_t useCounter = 0, hits = 0, misses = 0, evictions = 0, pointsSampled = 0;
+    double sampleSeconds = 0.0;
+};
+
+// Uma linha por nuvem trocada: do cache, ou quanto custou amostrá-la
+void reportOrbitalCloud(std::ostream& out, const OrbitalCloudCache& cache, const OrbitalCloudCache::Cloud& cloud, unsigned int threads) {
+    char line[256];
+    if (cache.lastHit) {
+        std::snprintf(line, sizeof(line), "Orbital %s de Z=%u: %zu pontos (do cache)", orbitalName(cloud.key).c_str(), cloud.key.z,
+                      cloud.points.size());
+    } else {
+        double rate = cloud.points.size() / std::max(cache.lastSeconds, 1e-9);
+        std::snprintf(line, sizeof(line), "Orbital %s de Z=%u: %zu pontos em %.0f ms, %.2f Mpontos/s (%.2f por thread), aceitacao angular %.0f%%",
+                      orbitalName(cloud.key).c_str(), cloud.key.z, cloud.points.size(), cache.lastSeconds * 1e3, rate * 1e-6,
+                      rate * 1e-6 / threads, cache.lastAcceptance * 100.0);
+    }
+    out << line << std::endl;
+}
+
+// Pontos da nuvem atual num vertex buffer estático, desenhados depois da cena opaca: testam a
+// profundidade (o núcleo esconde o que está atrás dele) mas não a escrevem, e se somam na tela
+class CloudRenderer {
+public:
+    void init() {
+        program = loadShaderProgram(cloudVertexShaderSource, cloudFragmentShaderSource);
+        pointScale = glGetUniformLocation(program.id, "pointScale");
+        intensity = glGetUniformLocation(program.id, "intensity");
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(CloudPoint), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
+
+    void upload(const std::vector<CloudPoint>& points) {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(CloudPoint), points.data(), GL_STATIC_DRAW);
+        count = (GLsizei)points.size();
+    }
+
+    // pixelsPerUnit como no SceneCuller; o brilho de cada ponto cai com a quantidade deles
+    void draw(float pixelsPerUnit) {
+        if (!count) return;
+        glUseProgram(program.id);
+        glUniform1f(pointScale, 0.04f * pixelsPerUnit);
+        glUniform1f(intensity, std::min(1.0f, 0.08f * std::sqrt(1e6f / count)));
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(vao);
+        glDrawArrays(GL_POINTS, 0, count);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+    }
+
+private:
+    ShaderProgram program;
+    GLint pointScale = -1, intensity = -1;
+    unsigned int vao = 0, vbo = 0;
+    GLsizei count = 0;
+};
+
+// ---- Modo sem janela: FBO, leitura por anel de PBOs e gravação numa thread ----
+
+enum class FrameFormat { Raw, Y4M, PNG };
+
+// CRC-32 dos chunks do PNG; pode continuar de um valor anterior
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t block = std::min<size_t>(size, 5552); // maior bloco sem estourar 32 bits antes do módulo
+        for (size_t i = 0; i < block; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += block;
+        size -= block;
+    }
+    return (b << 16) | a;
+}
+
+// PNG RGBA sem compressão (blocos "stored" do deflate): arquivos maiores, mas sem depender da zlib
+// e rápidos de gravar. `scratch` é reaproveitado entre quadros.
+bool writePng(const std::string& path, unsigned int width, unsigned int height, const uint8_t* rgba, std::vector<uint8_t>& scratch) {
+    auto put32 = [](std::vector<uint8_t>& out, uint32_t v) {
+        uint8_t bytes[4] = { uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v) };
+        out.insert(out.end(), bytes, bytes + 4);
+    };
+    // Linhas com o byte de filtro (0 = nenhum) na frente
+    size_t rowBytes = (size_t)width * 4;
+    std::vector<uint8_t> rows(height * (rowBytes + 1));
+    for (unsigned int y = 0; y < height; ++y) {
+        rows[y * (rowBytes + 1)] = 0;
+        std::memcpy(&rows[y * (rowBytes + 1) + 1], rgba + y * rowBytes, rowBytes);
+    }
+
+    // Chunk IDAT: tipo, fluxo zlib (cabeçalho, blocos de até 65535 bytes, Adler-32)
+    scratch.clear();
+    scratch.reserve(rows.size() + rows.size() / 65535 * 5 + 32);
+    put32(scratch, 0);
+    const uint8_t idat[] = { 'I', 'D', 'A', 'T', 0x78, 0x01 };
+    scratch.insert(scratch.end(), idat, idat + sizeof(idat));
+    for (size_t offset = 0;;) {
+        size_t block = std::min<size_t>(rows.size() - offset, 65535);
+        bool last = offset + block == rows.size();
+        uint8_t header[5] = { uint8_t(last ? 1 : 0), uint8_t(block), uint8_t(block >> 8), uint8_t(~block), uint8_t(~block >> 8) };
+        scratch.insert(scratch.end(), header, header + 5);
+        scratch.insert(scratch.end(), rows.begin() + offset, rows.begin() + offset + block);
+        offset += block;
+        if (last) break;
+    }
+    put32(scratch, adler32(rows.data(), rows.size()));
+    uint32_t length = (uint32_t)(scratch.size() - 8);
+    scratch[0] = uint8_t(length >> 24);
+    scratch[1] = uint8_t(length >> 16);
+    scratch[2] = uint8_t(length >> 8);
+    scratch[3] = uint8_t(length);
+    put32(scratch, crc32(scratch.data() + 4, scratch.size() - 4));
+
+    std::vector<uint8_t> ihdr;
+    const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    ihdr.insert(ihdr.end(), signature, signature + 8);
+    put32(ihdr, 13);
+    const uint8_t ihdrType[] = { 'I', 'H', 'D', 'R' };
+    ihdr.insert(ihdr.end(), ihdrType, ihdrType + 4);
+    put32(ihdr, width);
+    put32(ihdr, height);
+    const uint8_t format[] = { 8, 6, 0, 0, 0 }; // 8 bits, RGBA, deflate, filtro por linha, sem entrelaçamento
+    ihdr.insert(ihdr.end(), format, format + 5);
+    put32(ihdr, crc32(ihdr.data() + 12, 17));
+    const uint8_t iend[] = { 0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82 };
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(ihdr.data(), 1, ihdr.size(), file) == ihdr.size() &&
+              std::fwrite(scratch.data(), 1, scratch.size(), file) == scratch.size() &&
+              std::fwrite(iend, 1, sizeof(iend), file) == sizeof(iend);
+    return std::fclose(file) == 0 && ok;
+}
+
+// RGBA para YUV 4:2:0 (BT.601, faixa completa, como o C420jpeg do Y4M). Largura e altura pares.
+void rgbaToYuv420(const uint8_t* rgba, unsigned int width, unsigned int height, std::vector<uint8_t>& yuv) {
+    size_t lumaSize = (size_t)width * height, chromaSize = lumaSize / 4;
+    yuv.resize(lumaSize + 2 * chromaSize);
+    uint8_t* luma = yuv.data();
+    uint8_t* cb = luma + lumaSize;
+    uint8_t* cr = cb + chromaSize;
+    for (size_t i = 0; i < lumaSize; ++i) {
+        const uint8_t* p = rgba + i * 4;
+        luma[i] = uint8_t((19595 * p[0] + 38470 * p[1] + 7471 * p[2] + 32768) >> 16);
+    }
+    for (unsigned int y = 0; y < height; y += 2) {
+        for (unsigned int x = 0; x < width; x += 2) {
+            int r = 0, g = 0, b = 0;
+            for (unsigned int k = 0; k < 4; ++k) {
+                const uint8_t* p = rgba + ((size_t)(y + k / 2) * width + x + k % 2) * 4;
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            size_t c = (size_t)(y / 2) * (width / 2) + x / 2;
+            cb[c] = uint8_t((-11059 * r - 21709 * g + 32768 * b + (128 << 18) + (1 << 17)) >> 18);
+            cr[c] = uint8_t((32768 * r - 27439 * g - 5329 * b + (128 << 18) + (1 << 17)) >> 18);
+        }
+    }
+}
+
+// Grava os quadros lidos numa thread própria, para o disco não segurar o render. Os buffers circulam
+// entre as duas threads (no máximo FRAME_WRITER_BUFFERS deles), então a memória não cresce se o disco atrasar.
+const size_t FRAME_WRITER_BUFFERS = 4;
+
+class FrameWriter {
+public:
+    // path "-" = saída padrão (raw e Y4M). Para PNG, path é a base: "quadros.png" vira quadros_00000.png, ...
+    bool open(FrameFormat frameFormat, const std::string& path, unsigned int frameWidth, unsigned int frameHeight, unsigned int fps) {
+        format = frameFormat;
+        width = frameWidth;
+        height = frameHeight;
+        // Conferido antes de abrir: um Y4M recusado não deixa arquivo vazio nem FILE* aberto
+        if (format == FrameFormat::Y4M && (width % 2 || height % 2)) return false;
+        if (format == FrameFormat::PNG) {
+            if (path == "-") return false;
+            pngBase = path.size() > 4 && path.compare(path.size() - 4, 4, ".png") == 0 ? path.substr(0, path.size() - 4) : path;
+        } else if (path == "-") {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            file = stdout;
+        } else {
+            file = std::fopen(path.c_str(), "wb");
+            if (!file) return false;
+        }
+        if (format == FrameFormat::Y4M)
+            std::fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width, height, fps);
+        worker = std::thread(&FrameWriter::run, this);
+        return true;
+    }
+
+    // Buffer de width * height * 4 bytes para o próximo quadro (espera se todos estiverem na fila)
+    std::vector<uint8_t> acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return !freeBuffers.empty() || allocated < FRAME_WRITER_BUFFERS; });
+        if (freeBuffers.empty()) {
+            ++allocated;
+            return std::vector<uint8_t>((size_t)width * height * 4);
+        }
+        std::vector<uint8_t> buffer = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+        return buffer;
+    }
+
+    // Quadro RGBA de cima para baixo
+    void submit(std::vector<uint8_t> frame) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(frame));
+        }
+        changed.notify_all();
+    }
+
+    // Espera a fila esvaziar e fecha a saída. Devolve false se alguma escrita falhou.
+    bool close() {
+        if (!worker.joinable()) return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        changed.notify_all();
+        worker.join();
+        if (file && file != stdout) failed = std::fclose(file) != 0 || failed;
+        else if (file) std::fflush(stdout);
+        file = nullptr;
+        return !failed;
+    }
+
+    size_t framesWritten = 0;
+    double writeSeconds = 0.0;  // tempo gasto convertendo e gravando, na thread de escrita
+
+private:
+    void run() {
+        std::vector<uint8_t> scratch;
+        for (;;) {
+            std::vector<uint8_t> frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return closing || !pending.empty(); });
+                if (pending.empty()) return;
+                frame = std::move(pending.front());
+                pending.pop_front();
+            }
+            auto start = std::chrono::steady_clock::now();
+            if (format == FrameFormat::PNG) {
+                char suffix[32];
+                std::snprintf(suffix, sizeof(suffix), "_%05zu.png", framesWritten);
+                failed = !writePng(pngBase + suffix, width, height, frame.data(), scratch) || failed;
+            } else if (format == FrameFormat::Y4M) {
+                rgbaToYuv420(frame.data(), width, height, scratch);
+                failed = std::fwrite("FRAME\n", 1, 6, file) != 6 || failed;
+                failed = std::fwrite(scratch.data(), 1, scratch.size(), file) != scratch.size() || failed;
+            } else {
+                failed = std::fwrite(frame.data(), 1, frame.size(), file) != frame.size() || failed;
+            }
+            writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            ++framesWritten;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeBuffers.push_back(std::move(frame));
+            }
+            changed.notify_all();
+        }
+    }
+
+    FrameFormat format = FrameFormat::Raw;
+    unsigned int width = 0, height = 0;
+    std::string pngBase;
+    FILE* file = nullptr;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> pending;
+    std::vector<std::vector<uint8_t>> freeBuffers;
+    size_t allocated = 0;
+    bool closing = false;
+    bool failed = false;
+};
+
+// Quadros em leitura ao mesmo tempo: o quadro N é lido enquanto N + 1 e N + 2 são desenhados
+const unsigned int READBACK_RING = 3;
+
+// Framebuffer fora da tela, de qualquer tamanho, com leitura assíncrona por PBOs
+class OffscreenTarget {
+public:
+    bool init(unsigned int targetWidth, unsigned int targetHeight) {
+        width = targetWidth;
+        height = targetHeight;
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) return false;
+
+        glGenBuffers(READBACK_RING, pbos);
+        for (unsigned int i = 0; i < READBACK_RING; ++i) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    // Depois de desenhar: começa a leitura deste quadro e, com o anel cheio, entrega o mais antigo
+    void readback(FrameWriter* writer) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[issued % READBACK_RING]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        ++issued;
+        if (issued - completed == READBACK_RING) collect(writer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // Entrega os quadros que ainda estão no anel
+    void finish(FrameWriter* writer) {
+        while (completed < issued) collect(writer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    double mapSeconds = 0.0; // tempo esperando pelo mapeamento (leitura que não chegou a se sobrepor)
+    // Quadros cujo CRC-32 vai para checksums (o mesmo do quadro gravado com --formato raw)
+    std::vector<unsigned int> checksumFrames;
+    std::vector<std::pair<unsigned int, uint32_t>> checksums;
+
+private:
+    void collect(FrameWriter* writer) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[completed % READBACK_RING]);
+        auto start = std::chrono::steady_clock::now();
+        const uint8_t* pixels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)width * height * 4, GL_MAP_READ_BIT);
+        mapSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (pixels && writer) {
+            // O OpenGL lê de baixo para cima; os formatos de saída vão de cima para baixo
+            std::vector<uint8_t> frame = writer->acquire();
+            size_t rowBytes = (size_t)width * 4;
+            for (unsigned int y = 0; y < height; ++y)
+                std::memcpy(frame.data() + y * rowBytes, pixels + (size_t)(height - 1 - y) * rowBytes, rowBytes);
+            writer->submit(std::move(frame));
+        }
+        if (pixels && std::find(checksumFrames.begin(), checksumFrames.end(), completed) != checksumFrames.end()) {
+            uint32_t crc = 0;
+            size_t rowBytes = (size_t)width * 4;
+            for (unsigned int y = height; y-- > 0;) crc = crc32(pixels + y * rowBytes, rowBytes, crc);
+            checksums.push_back({ (unsigned int)completed, crc });
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        ++completed;
+    }
+
+    unsigned int width = 0, height = 0;
+    unsigned int fbo = 0, renderbuffers[2] = {}, pbos[READBACK_RING] = {};
+    uint64_t issued = 0, completed = 0;
+};
+
+// ---- Trajetórias gravadas ----
+
+// Arquivo .trj (little-endian): cabeçalho, parte fixa das instâncias e das órbitas, blocos de quadros e,
+// no fim, o índice dos quadros. Um quadro é o array das posições das instâncias na ordem do buffer da cena
+// (núcleos, depois elétrons), quantizadas em int16 dentro do cubo da cena. É o mesmo formato que o vertex
+// shader lê, então a reprodução copia o quadro do arquivo mapeado para o anel sem decodificar nada.
+const char TRAJECTORY_MAGIC[8] = { 'A', 'T', 'O', 'M', 'O', 'T', 'R', 'J' };
+const char TRAJECTORY_CHUNK_MAGIC[4] = { 'T', 'R', 'J', 'C' };
+const uint32_t TRAJECTORY_VERSION = 1;
+// Os blocos começam em múltiplos da página, para o leitor poder devolver ao sistema os que ficaram para trás
+const size_t TRAJECTORY_PAGE = 4096;
+// Tamanho alvo de um bloco e limite de quadros por bloco. O bloco é a unidade de escrita e de residência.
+const size_t TRAJECTORY_CHUNK_BYTES = 8u << 20;
+const uint32_t TRAJECTORY_MAX_CHUNK_FRAMES = 1024;
+// Blocos circulando entre a thread principal e a de escrita
+const size_t TRAJECTORY_WRITER_BUFFERS = 3;
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;      // sizeof(TrajectoryHeader) da versão que gravou
+    uint32_t instanceCount;    // núcleos + elétrons por quadro
+    uint32_t atomCount;
+    uint32_t frameCount;       // 0 até a gravação terminar
+    uint32_t framesPerChunk;
+    uint32_t frameStride;      // bytes entre quadros de um bloco
+    uint32_t chunkHeaderBytes; // TrajectoryChunkHeader + tempos dos quadros, arredondado para a página
+    float center[3];           // posição = center + step * (x, y, z) quantizados
+    float step;
+    uint64_t instancesOffset;  // TrajectoryInstance[instanceCount]
+    uint64_t orbitsOffset;     // OrbitParams[orbitCount]
+    uint64_t orbitCount;
+    uint64_t firstChunkOffset;
+    uint64_t indexOffset;      // TrajectoryIndexEntry[frameCount]; 0 = gravação interrompida
+};
+static_assert(sizeof(TrajectoryHeader) == 96, "TrajectoryHeader faz parte do formato do arquivo");
+
+// Parte fixa de uma instância
+struct TrajectoryInstance {
+    float scale;    // raio da esfera
+    uint32_t color; // RGBA8
+};
+
+// Posição de uma instância num quadro; w fica em 0 e mantém os 8 bytes alinhados
+struct TrajectoryPosition {
+    int16_t x, y, z, w;
+};
+
+// Começo de um bloco, seguido de float times[framesPerChunk]
+struct TrajectoryChunkHeader {
+    char magic[4];
+    uint32_t firstFrame;
+    uint32_t frameCount;
+    uint32_t reserved;
+};
+
+struct TrajectoryIndexEntry {
+    uint64_t offset; // do quadro, desde o começo do arquivo
+    float time;
+    uint32_t chunk;
+};
+static_assert(sizeof(TrajectoryIndexEntry) == 16, "TrajectoryIndexEntry faz parte do formato do arquivo");
+
+size_t alignUp(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+// Bytes ocupados no arquivo por um bloco com `frames` quadros
+size_t trajectoryChunkBytes(const TrajectoryHeader& header, uint32_t frames) {
+    return alignUp(header.chunkHeaderBytes + (size_t)frames * header.frameStride, TRAJECTORY_PAGE);
+}
+
+// Quantiza as posições de um quadro (centro da matriz de cada instância) e grava numa thread própria.
+// Os blocos circulam entre as duas threads como os buffers do FrameWriter, então a memória fica limitada
+// a TRAJECTORY_WRITER_BUFFERS blocos mesmo que o disco atrase.
+class TrajectoryWriter {
+public:
+    // `instances` é o primeiro quadro; o raio e a cor de cada instância saem dele. O cubo center ± radius
+    // precisa conter a cena inteira. `orbits` são gravadas para a reprodução desenhar os mesmos anéis.
+    bool open(const std::string& path, const std::vector<ElectronInstance>& instances, size_t atomCount,
+              const glm::vec3& center, float radius, const std::vector<OrbitParams>& orbits) {
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        header = TrajectoryHeader();
+        std::memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+        header.version = TRAJECTORY_VERSION;
+        header.headerBytes = sizeof(TrajectoryHeader);
+        header.instanceCount = (uint32_t)instances.size();
+        header.atomCount = (uint32_t)atomCount;
+        header.frameStride = (uint32_t)alignUp(std::max<size_t>(1, instances.size()) * sizeof(TrajectoryPosition), 16);
+        header.framesPerChunk = (uint32_t)std::min<size_t>(TRAJECTORY_MAX_CHUNK_FRAMES, std::max<size_t>(1, TRAJECTORY_CHUNK_BYTES / header.frameStride));
+        header.chunkHeaderBytes = (uint32_t)alignUp(sizeof(TrajectoryChunkHeader) + header.framesPerChunk * sizeof(float), TRAJECTORY_PAGE);
+        for (int a = 0; a < 3; ++a) header.center[a] = center[a];
+        header.step = std::max(radius, 1e-3f) / 32767.0f;
+
+        std::vector<TrajectoryInstance> fixed(instances.size());
+        for (size_t i = 0; i < instances.size(); ++i) {
+            fixed[i].scale = glm::length(glm::vec3(instances[i].model[0]));
+            fixed[i].color = packColor(instances[i].color);
+        }
+        header.instancesOffset = sizeof(TrajectoryHeader);
+        header.orbitsOffset = alignUp(header.instancesOffset + fixed.size() * sizeof(TrajectoryInstance), 16);
+        header.orbitCount = orbits.size();
+        header.firstChunkOffset = alignUp(header.orbitsOffset + orbits.size() * sizeof(OrbitParams), TRAJECTORY_PAGE);
+
+        // frameCount e indexOffset ficam em 0 até close(): um arquivo interrompido é reconhecido pelo leitor
+        written = 0;
+        failed = false;
+        write(&header, sizeof(header));
+        write(fixed.data(), fixed.size() * sizeof(TrajectoryInstance));
+        padTo(header.orbitsOffset);
+        write(orbits.data(), orbits.size() * sizeof(OrbitParams));
+        padTo(header.firstChunkOffset);
+        if (failed) {
+            std::fclose(file);
+            file = nullptr;
+            return false;
+        }
+        worker = std::thread(&TrajectoryWriter::run, this);
+        return true;
+    }
+
+    bool isOpen() const { return file != nullptr; }
+
+    // Acrescenta o quadro do tempo `time`. Com o bloco cheio, ele vai para a thread de escrita.
+    void addFrame(const std::vector<ElectronInstance>& instances, float time) {
+        auto start = std::chrono::steady_clock::now();
+        if (chunk.empty()) {
+            chunk = acquire();
+            std::memset(chunk.data(), 0, header.chunkHeaderBytes);
+            TrajectoryChunkHeader* chunkHeader = (TrajectoryChunkHeader*)chunk.data();
+            std::memcpy(chunkHeader->magic, TRAJECTORY_CHUNK_MAGIC, sizeof(chunkHeader->magic));
+            chunkHeader->firstFrame = framesAdded;
+        }
+        TrajectoryChunkHeader* chunkHeader = (TrajectoryChunkHeader*)chunk.data();
+        float* times = (float*)(chunk.data() + sizeof(TrajectoryChunkHeader));
+        uint8_t* frame = chunk.data() + header.chunkHeaderBytes + (size_t)chunkHeader->frameCount * header.frameStride;
+        TrajectoryPosition* out = (TrajectoryPosition*)frame;
+        const glm::vec3 center(header.center[0], header.center[1], header.center[2]);
+        const float inverseStep = 1.0f / header.step;
+        size_t count = std::min<size_t>(instances.size(), header.instanceCount);
+        for (size_t i = 0; i < count; ++i) {
+            glm::vec3 q = glm::clamp(glm::round((glm::vec3(instances[i].model[3]) - center) * inverseStep), -32767.0f, 32767.0f);
+            out[i] = { (int16_t)q.x, (int16_t)q.y, (int16_t)q.z, 0 };
+        }
+        std::memset(out + count, 0, header.frameStride - count * sizeof(TrajectoryPosition));
+        times[chunkHeader->frameCount++] = time;
+        ++framesAdded;
+        if (chunkHeader->frameCount == header.framesPerChunk) submitChunk();
+        quantizeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Grava o bloco incompleto e o índice, e completa o cabeçalho. Devolve false se alguma escrita falhou.
+    bool close() {
+        if (!file) return false;
+        if (!chunk.empty()) submitChunk();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        changed.notify_all();
+        worker.join();
+        header.frameCount = (uint32_t)index.size();
+        header.indexOffset = written;
+        write(index.data(), index.size() * sizeof(TrajectoryIndexEntry));
+        failed = std::fseek(file, 0, SEEK_SET) != 0 || failed;
+        failed = std::fwrite(&header, sizeof(header), 1, file) != 1 || failed;
+        failed = std::fclose(file) != 0 || failed;
+        file = nullptr;
+        return !failed;
+    }
+
+    void report(std::ostream& out) const {
+        size_t frameBytes = (size_t)header.instanceCount * sizeof(TrajectoryPosition);
+        char line[320];
+        std::snprintf(line, sizeof(line), "Trajetoria gravada: %u quadros, %.1f MB (%zu bytes por quadro, %zu por instancia, "
+                      "contra %zu das matrizes), quantizacao %.3f ms por quadro, gravacao %.2f s na thread de escrita",
+                      header.frameCount, written / 1048576.0, frameBytes, sizeof(TrajectoryPosition), sizeof(ElectronInstance),
+                      quantizeSeconds * 1e3 / std::max<uint32_t>(1, header.frameCount), writeSeconds);
+        out << line << std::endl;
+    }
+
+private:
+    std::vector<uint8_t> acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return !freeBuffers.empty() || allocated < TRAJECTORY_WRITER_BUFFERS; });
+        if (freeBuffers.empty()) {
+            ++allocated;
+            return std::vector<uint8_t>(trajectoryChunkBytes(header, header.framesPerChunk));
+        }
+        std::vector<uint8_t> buffer = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+        return buffer;
+    }
+
+    void submitChunk() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(chunk));
+        }
+        chunk.clear();
+        changed.notify_all();
+    }
+
+    void run() {
+        for (;;) {
+            std::vector<uint8_t> buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return closing || !pending.empty(); });
+                if (pending.empty()) return;
+                buffer = std::move(pending.front());
+                pending.pop_front();
+            }
+            auto start = std::chrono::steady_clock::now();
+            const TrajectoryChunkHeader* chunkHeader = (const TrajectoryChunkHeader*)buffer.data();
+            const float* times = (const float*)(buffer.data() + sizeof(TrajectoryChunkHeader));
+            for (uint32_t k = 0; k < chunkHeader->frameCount; ++k)
+                index.push_back({ written + header.chunkHeaderBytes + (uint64_t)k * header.frameStride, times[k], chunksWritten });
+            size_t bytes = trajectoryChunkBytes(header, chunkHeader->frameCount);
+            std::memset(buffer.data() + header.chunkHeaderBytes + (size_t)chunkHeader->frameCount * header.frameStride, 0,
+                        bytes - header.chunkHeaderBytes - (size_t)chunkHeader->frameCount * header.frameStride);
+            write(buffer.data(), bytes);
+            ++chunksWritten;
+            writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeBuffers.push_back(std::move(buffer));
+            }
+            changed.notify_all();
+        }
+    }
+
+    void write(const void* data, size_t bytes) {
+        if (bytes == 0) return;
+        failed = std::fwrite(data, 1, bytes, file) != bytes || failed;
+        written += bytes;
+    }
+
+    void padTo(uint64_t offset) {
+        static const uint8_t zeros[TRAJECTORY_PAGE] = {};
+        while (written < offset) write(zeros, (size_t)std::min<uint64_t>(offset - written, sizeof(zeros)));
+    }
+
+    TrajectoryHeader header = {};
+    FILE* file = nullptr;
+    uint64_t written = 0;           // só a thread de escrita mexe depois de open()
+    uint32_t framesAdded = 0, chunksWritten = 0;
+    std::vector<uint8_t> chunk;     // bloco sendo preenchido pela thread principal
+    std::vector<TrajectoryIndexEntry> index;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> pending;
+    std::vector<std::vector<uint8_t>> freeBuffers;
+    size_t allocated = 0;
+    bool closing = false;
+    bool failed = false;
+    double quantizeSeconds = 0.0, writeSeconds = 0.0;
+};
+
+// Arquivo inteiro mapeado na memória, só para leitura. As páginas vêm do disco quando são tocadas.
+class MappedFile {
+public:
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return false;
+        bytes = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!bytes) return false;
+        length = (size_t)fileSize.QuadPart;
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) return false;
+        void* address = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) return false;
+        bytes = (const uint8_t*)address;
+        length = (size_t)info.st_size;
+        madvise(address, length, MADV_RANDOM); // o acesso é por bloco, pedido explicitamente em willNeed
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) munmap((void*)bytes, length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    // O trecho vai ser lido em breve: o sistema pode começar a trazê-lo do disco
+    void willNeed(size_t offset, size_t count) const {
+#ifndef _WIN32
+        size_t begin = offset / TRAJECTORY_PAGE * TRAJECTORY_PAGE;
+        madvise((void*)(bytes + begin), std::min(offset + count, length) - begin, MADV_WILLNEED);
+#endif
+    }
+
+    // O trecho não vai ser lido tão cedo: sai da memória do processo (e volta do arquivo se for tocado de novo)
+    void dontNeed(size_t offset, size_t count) const {
+        size_t begin = offset / TRAJECTORY_PAGE * TRAJECTORY_PAGE;
+        size_t end = std::min(offset + count, length);
+#ifdef _WIN32
+        VirtualUnlock((void*)(bytes + begin), end - begin); // fora de um VirtualLock, só tira as páginas do working set
+#else
+        madvise((void*)(bytes + begin), end - begin, MADV_DONTNEED);
+#endif
+    }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Trajetória mapeada: qualquer quadro sai do índice em O(1), como um ponteiro para dentro do arquivo.
+// Só o bloco do quadro atual e o seguinte ficam residentes; os outros são devolvidos ao sistema ao trocar de bloco.
+class TrajectoryReader {
+public:
+    bool open(const std::string& path, std::ostream& errors) {
+        if (!file.open(path)) {
+            errors << "Nao foi possivel abrir a trajetoria " << path << std::endl;
+            return false;
+        }
+        if (file.size() < sizeof(TrajectoryHeader) || std::memcmp(file.data(), TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0) {
+            errors << path << " nao e um arquivo de trajetoria" << std::endl;
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.version != TRAJECTORY_VERSION || header.headerBytes < sizeof(TrajectoryHeader)) {
+            errors << "Versao de trajetoria nao suportada: " << header.version << " (esta versao le a " << TRAJECTORY_VERSION << ")" << std::endl;
+            return false;
+        }
+        if (!fitsInFile(header.instancesOffset, header.instanceCount, sizeof(TrajectoryInstance)) ||
+            !fitsInFile(header.orbitsOffset, header.orbitCount, sizeof(OrbitParams)) || header.firstChunkOffset >= file.size() ||
+            header.atomCount > header.instanceCount ||
+            header.frameStride < header.instanceCount * sizeof(TrajectoryPosition) || header.framesPerChunk == 0 ||
+            header.chunkHeaderBytes < sizeof(TrajectoryChunkHeader) + header.framesPerChunk * sizeof(float)) {
+            errors << path << " esta corrompido (secoes fora do arquivo)" << std::endl;
+            return false;
+        }
+        bool hasIndex = header.indexOffset && fitsInFile(header.indexOffset, header.frameCount, sizeof(TrajectoryIndexEntry));
+        bool indexCorrupted = hasIndex && !indexIsValid((const TrajectoryIndexEntry*)(file.data() + header.indexOffset), header.frameCount);
+        if (hasIndex && !indexCorrupted) {
+            index = (const TrajectoryIndexEntry*)(file.data() + header.indexOffset);
+            count = header.frameCount;
+        } else {
+            // Gravação interrompida (ou índice estragado): o índice é refeito percorrendo os blocos completos
+            uint64_t offset = header.firstChunkOffset;
+            uint32_t chunk = 0;
+            while (offset <= file.size() && header.chunkHeaderBytes <= file.size() - offset) {
+                const TrajectoryChunkHeader* chunkHeader = (const TrajectoryChunkHeader*)(file.data() + offset);
+                if (std::memcmp(chunkHeader->magic, TRAJECTORY_CHUNK_MAGIC, sizeof(chunkHeader->magic)) != 0 ||
+                    chunkHeader->frameCount == 0 || chunkHeader->frameCount > header.framesPerChunk ||
+                    !fitsInFile(offset + header.chunkHeaderBytes, chunkHeader->frameCount, header.frameStride))
+                    break;
+                const float* times = (const float*)(chunkHeader + 1);
+                for (uint32_t k = 0; k < chunkHeader->frameCount; ++k)
+                    rebuiltIndex.push_back({ offset + header.chunkHeaderBytes + (uint64_t)k * header.frameStride, times[k], chunk });
+                offset += trajectoryChunkBytes(header, chunkHeader->frameCount);
+                ++chunk;
+            }
+            if (!indexIsValid(rebuiltIndex.data(), rebuiltIndex.size())) {
+                errors << path << " esta corrompido (tempos dos quadros fora de ordem)" << std::endl;
+                return false;
+            }
+            index = rebuiltIndex.data();
+            count = rebuiltIndex.size();
+            if (indexCorrupted)
+                errors << "Indice de " << path << " esta corrompido: refeito a partir de " << chunk << " blocos" << std::endl;
+            else
+                errors << "Trajetoria sem indice (gravacao interrompida?): refeito a partir de " << chunk << " blocos" << std::endl;
+        }
+        if (count == 0) {
+            errors << path << " nao tem quadros" << std::endl;
+            return false;
+        }
+        char line[256];
+        std::snprintf(line, sizeof(line), "Trajetoria %s: %zu quadros (%.2f s) de %u instancias (%u atomos), %zu bytes por quadro, "
+                      "blocos de %u quadros", path.c_str(), count, index[count - 1].time - index[0].time, header.instanceCount,
+                      header.atomCount, frameBytes(), header.framesPerChunk);
+        errors << line << std::endl;
+        return true;
+    }
+
+    size_t frameCount() const { return count; }
+    size_t frameBytes() const { return (size_t)header.instanceCount * sizeof(TrajectoryPosition); }
+    uint32_t instanceCount() const { return header.instanceCount; }
+    uint32_t atomCount() const { return header.atomCount; } // as outras instâncias são elétrons
+    float frameTime(size_t frame) const { return index[frame].time; }
+
+    // Último quadro com tempo <= time (o primeiro, se time vier antes dele)
+    size_t frameAt(float time) const {
+        const TrajectoryIndexEntry* end = index + count;
+        const TrajectoryIndexEntry* after = std::upper_bound(index, end, time,
+                                                             [](float t, const TrajectoryIndexEntry& e) { return t < e.time; });
+        return after == index ? 0 : (size_t)(after - index) - 1;
+    }
+
+    // Posições do quadro, direto do mapeamento. Ao entrar num bloco novo, pede o seguinte e libera o anterior.
+    const TrajectoryPosition* frame(size_t number) {
+        uint32_t chunk = index[number].chunk;
+        if (chunk != residentChunk) {
+            if (residentChunk != UINT32_MAX) {
+                for (uint32_t c = residentChunk; c <= residentChunk + 1 && c < chunkCount(); ++c)
+                    if (c != chunk && c != chunk + 1) file.dontNeed(chunkOffset(c), chunkSize(c));
+            }
+            size_t window = 0;
+            for (uint32_t c = chunk; c <= chunk + 1 && c < chunkCount(); ++c) {
+                file.willNeed(chunkOffset(c), chunkSize(c));
+                window += chunkSize(c);
+            }
+            largestWindow = std::max(largestWindow, window);
+            residentChunk = chunk;
+        }
+        ++framesRead;
+        return (const TrajectoryPosition*)(file.data() + index[number].offset);
+    }
+
+    const TrajectoryInstance* instances() const { return (const TrajectoryInstance*)(file.data() + header.instancesOffset); }
+    const OrbitParams* orbits() const { return (const OrbitParams*)(file.data() + header.orbitsOffset); }
+    size_t orbitCount() const { return (size_t)header.orbitCount; }
+    glm::vec3 center() const { return glm::vec3(header.center[0], header.center[1], header.center[2]); }
+    float step() const { return header.step; }
+    float radius() const { return header.step * 32767.0f; }
+
+    void report(std::ostream& out) const {
+        char line[256];
+        std::snprintf(line, sizeof(line), "Trajetoria: %zu quadros lidos, %.1f MB mapeados, no maximo %.1f MB de blocos mantidos na memoria",
+                      framesRead, file.size() / 1048576.0, largestWindow / 1048576.0);
+        out << line << std::endl;
+    }
+
+private:
+    // count elementos de elementSize bytes a partir de offset cabem no arquivo. Escrito sem somar offset ao tamanho,
+    // que num cabeçalho estragado (offsets perto de 2^64) daria a volta e passaria na conferência
+    bool fitsInFile(uint64_t offset, uint64_t elementCount, size_t elementSize) const {
+        return offset <= file.size() && (elementSize == 0 || elementCount <= (file.size() - offset) / elementSize);
+    }
+
+    // frame() devolve file.data() + offset sem conferir, chunkOffset()/chunkSize() confiam em chunk e frameAt() faz
+    // busca binária pelo tempo: cada entrada precisa apontar para um quadro inteiro dentro do arquivo, no bloco
+    // i / framesPerChunk (é o que chunkOffset supõe), com tempos sem voltar atrás
+    bool indexIsValid(const TrajectoryIndexEntry* entries, size_t entryCount) const {
+        for (size_t i = 0; i < entryCount; ++i) {
+            const TrajectoryIndexEntry& entry = entries[i];
+            if (entry.offset < header.firstChunkOffset || entry.offset - header.firstChunkOffset < header.chunkHeaderBytes ||
+                !fitsInFile(entry.offset, 1, frameBytes()) || entry.chunk != i / header.framesPerChunk ||
+                (i > 0 && !(entry.time >= entries[i - 1].time)))
+                return false;
+        }
+        return true;
+    }
+
+    uint32_t chunkCount() const { return index[count - 1].chunk + 1; }
+
+    // Os blocos têm framesPerChunk quadros (só o último pode ter menos), então o primeiro quadro de cada um é conhecido
+    size_t chunkOffset(uint32_t chunk) const {
+        return (size_t)index[(size_t)chunk * header.framesPerChunk].offset - header.chunkHeaderBytes;
+    }
+
+    size_t chunkSize(uint32_t chunk) const {
+        size_t first = (size_t)chunk * header.framesPerChunk;
+        return trajectoryChunkBytes(header, (uint32_t)std::min<size_t>(header.framesPerChunk, count - first));
+    }
+
+    MappedFile file;
+    TrajectoryHeader header = {};
+    const TrajectoryIndexEntry* index = nullptr;
+    size_t count = 0;
+    std::vector<TrajectoryIndexEntry> rebuiltIndex;
+    uint32_t residentChunk = UINT32_MAX;
+    size_t framesRead = 0;
+    size_t largestWindow = 0; // maior soma dos blocos pedidos (o atual e o seguinte)
+};
+
+// Desenha o quadro da trajetória numa chamada instanciada: posições no anel (copiadas do mapeamento como estão),
+// raio e cor num buffer fixo carregado uma vez. Sem culling, que exigiria juntar as instâncias visíveis numa cópia.
+class TrajectoryRenderer {
+public:
+    void init(const TrajectoryReader& trajectory, const GeometryPool& geometry) {
+        programs[0] = loadShaderProgram(trajectoryVertexShaderSource, fragmentShaderSource);
+        programs[1] = loadShaderProgram(trajectoryImpostorVertexShaderSource, impostorFragmentShaderSource);
+        glm::vec3 center = trajectory.center();
+        for (const ShaderProgram& program : programs) {
+            glUseProgram(program.id);
+            glUniform4f(glGetUniformLocation(program.id, "quantization"), center.x, center.y, center.z, trajectory.step());
+        }
+        glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)trajectory.instanceCount() * sizeof(TrajectoryInstance), trajectory.instances(), GL_STATIC_DRAW);
+        vaos[0] = geometry.createVertexArray();
+        glGenVertexArrays(1, &vaos[1]);
+        for (unsigned int vao : vaos) {
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(TrajectoryInstance), (void*)offsetof(TrajectoryInstance, scale));
+            glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TrajectoryInstance), (void*)offsetof(TrajectoryInstance, color));
+            for (int location : { 2, 3, 6 }) {
+                glEnableVertexAttribArray(location);
+                glVertexAttribDivisor(location, 1);
+            }
+        }
+        instanceCount = trajectory.instanceCount();
+        quad.mode = GL_TRIANGLE_STRIP;
+        quad.count = 4;
+    }
+
+    // Antes de stream.flush(): o quadro vai para o anel e o desenho para a fila
+    void queue(RenderQueue& renderQueue, StreamBuffer& stream, const TrajectoryPosition* frame, bool impostors, const MeshHandle& sphere) {
+        size_t bytes = (size_t)instanceCount * sizeof(TrajectoryPosition);
+        StreamBuffer::Allocation positions = stream.allocate(bytes, 16);
+        std::memcpy(positions.data, frame, bytes);
+        unsigned int vao = vaos[impostors ? 1 : 0];
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+        glVertexAttribPointer(2, 3, GL_SHORT, GL_FALSE, sizeof(TrajectoryPosition), (void*)positions.offset);
+        renderQueue.drawInstanced(programs[impostors ? 1 : 0], vao, impostors ? quad : sphere, (GLsizei)instanceCount);
+    }
+
+private:
+    ShaderProgram programs[2]; // malha, impostor
+    unsigned int vaos[2] = {};
+    unsigned int instanceVBO = 0;
+    uint32_t instanceCount = 0;
+    MeshHandle quad;
+};
+
+// ---- Perfil do frame ----
+
+// Amostras guardadas por série para os percentis (~4 s a 60 quadros/s)
+const size_t PROFILE_WINDOW = 240;
+// Frames de atraso na leitura das consultas de tempo da GPU: o resultado já chegou e a leitura não para o pipeline
+const unsigned int GPU_QUERY_LATENCY = 4;
+const unsigned int MAX_GPU_PASSES = 8;
+// Limite de eventos guardados para o trace (~32 bytes cada)
+const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+// Percentil p (0..1) pelo posto mais próximo
+float samplePercentile(std::vector<float> samples, float p) {
+    if (samples.empty()) return 0.0f;
+    size_t k = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+// Tempos de CPU por etapa do frame e de GPU por passo (GL_TIME_ELAPSED), com percentis das últimas
+// PROFILE_WINDOW amostras e exportação no formato trace_event do Chrome (chrome://tracing, Perfetto).
+// Desligado, cada marcação custa só um teste.
+class FrameProfiler {
+public:
+    bool enabled = false;
+
+    void start(bool gpuTimers) {
+        enabled = true;
+        gpu = gpuTimers;
+        origin = std::chrono::steady_clock::now();
+        if (gpu) glGenQueries(GPU_QUERY_LATENCY * MAX_GPU_PASSES, &queries[0][0]);
+    }
+
+    // Nanossegundos desde start()
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void beginFrame() {
+        if (!enabled) return;
+        if (gpu) collectGpu();
+        frameStart = now();
+    }
+
+    void endFrame() {
+        if (!enabled) return;
+        int64_t end = now();
+        closeStage(end);
+        addCpu("frame", frameStart, end);
+        ++frameIndex;
+    }
+
+    // Encerra a etapa de CPU em andamento e começa a próxima; as etapas são sequenciais dentro do frame
+    void stage(const char* name) {
+        if (!enabled) return;
+        int64_t t = now();
+        closeStage(t);
+        stageName = name;
+        stageStart = t;
+    }
+
+    // Passos da GPU não podem se sobrepor (uma consulta GL_TIME_ELAPSED por vez)
+    void beginGpu(const char* name) {
+        if (!enabled || !gpu) return;
+        unsigned int slot = frameIndex % GPU_QUERY_LATENCY;
+        if (gpuPassCount[slot] == MAX_GPU_PASSES) return;
+        GpuPass& pass = gpuPasses[slot][gpuPassCount[slot]];
+        pass.name = name;
+        pass.issued = now();
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot][gpuPassCount[slot]]);
+        gpuActive = true;
+    }
+
+    void endGpu() {
+        if (!gpuActive) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        ++gpuPassCount[frameIndex % GPU_QUERY_LATENCY];
+        gpuActive = false;
+    }
+
+    // Tabela com p50/p95/p99 de cada série: primeiro as da CPU, depois as da GPU, na ordem em que apareceram
+    void report(std::ostream& out) const {
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-22s %8s %8s %8s\n", "perfil (ms)", "p50", "p95", "p99");
+        out << line;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (const Series& s : allSeries) {
+                if (s.gpu != (pass == 1)) continue;
+                std::snprintf(line, sizeof(line), "%-4s%-18s %8.3f %8.3f %8.3f\n", s.gpu ? "GPU" : "CPU", s.name,
+                              s.percentile(0.50f), s.percentile(0.95f), s.percentile(0.99f));
+                out << line;
+            }
+        }
+        if (gpuDiscarded) out << gpuDiscarded << " consultas da GPU descartadas (sem resultado a tempo ou com tempo invalido)\n";
+    }
+
+    // Resumo para o título da janela
+    std::string frameSummary() const {
+        for (const Series& s : allSeries) {
+            if (!s.gpu && std::strcmp(s.name, "frame") == 0) {
+                char text[96];
+                std::snprintf(text, sizeof(text), "frame p50 %.2f / p95 %.2f / p99 %.2f ms", s.percentile(0.50f),
+                              s.percentile(0.95f), s.percentile(0.99f));
+                return text;
+            }
+        }
+        return std::string();
+    }
+
+    bool writeTrace(const std::string& path) const {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) return false;
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"principal\"}},\n", MAIN_THREAD);
+        std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", GPU_THREAD);
+        for (const TraceEvent& e : traceEvents)
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", e.name,
+                         e.thread == GPU_THREAD ? "gpu" : "cpu", e.thread, e.begin * 1e-3, e.duration * 1e-3);
+        std::fprintf(file, "\n]}\n");
+        return std::fclose(file) == 0;
+    }
+
+private:
+    static const int MAIN_THREAD = 1, GPU_THREAD = 2;
+
+    struct Series {
+        const char* name;
+        bool gpu;
+        std::vector<float> samples;
+        size_t next = 0;
+
+        void add(float ms) {
+            if (samples.size() < PROFILE_WINDOW) samples.push_back(ms);
+            else samples[next] = ms;
+            next = (next + 1) % PROFILE_WINDOW;
+        }
+
+        float percentile(float p) const { return samplePercentile(samples, p); }
+    };
+
+    struct TraceEvent {
+        const char* name;
+        int64_t begin, duration;  // ns
+        int thread;
+    };
+
+    struct GpuPass {
+        const char* name;
+        int64_t issued;
+    };
+
+    void addCpu(const char* name, int64_t begin, int64_t end) {
+        series(name, false).add((end - begin) * 1e-6f);
+        addTraceEvent(name, begin, end - begin, MAIN_THREAD);
+    }
+
+    void closeStage(int64_t end) {
+        if (stageName) addCpu(stageName, stageStart, end);
+        stageName = nullptr;
+    }
+
+    // Os nomes são literais, então a comparação de ponteiros basta na maioria das vezes
+    Series& series(const char* name, bool isGpu) {
+        for (Series& s : allSeries)
+            if (s.gpu == isGpu && (s.name == name || std::strcmp(s.name, name) == 0)) return s;
+        allSeries.push_back({ name, isGpu, {}, 0 });
+        allSeries.back().samples.reserve(PROFILE_WINDOW);
+        return allSeries.back();
+    }
+
+    void addTraceEvent(const char* name, int64_t begin, int64_t duration, int thread) {
+        if (traceEvents.size() < MAX_TRACE_EVENTS) traceEvents.push_back({ name, begin, duration, thread });
+    }
+
+    // Lê as consultas do frame que vai reusar este slot (GPU_QUERY_LATENCY frames atrás), sem esperar
+    void collectGpu() {
+        unsigned int slot = frameIndex % GPU_QUERY_LATENCY;
+        for (unsigned int i = 0; i < gpuPassCount[slot]; ++i) {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[slot][i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                ++gpuDiscarded;
+                continue;
+            }
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[slot][i], GL_QUERY_RESULT, &elapsed);
+            // Um passo não pode ter durado mais que o tempo desde que foi enviado (o llvmpipe devolve lixo na primeira consulta)
+            if ((int64_t)elapsed > now() - gpuPasses[slot][i].issued) {
+                ++gpuDiscarded;
+                continue;
+            }
+            series(gpuPasses[slot][i].name, true).add(elapsed * 1e-6f);
+            // O trace posiciona o passo da GPU no instante em que foi enviado pela CPU
+            addTraceEvent(gpuPasses[slot][i].name, gpuPasses[slot][i].issued, (int64_t)elapsed, GPU_THREAD);
+        }
+        gpuPassCount[slot] = 0;
+    }
+
+    bool gpu = false, gpuActive = false;
+    std::chrono::steady_clock::time_point origin;
+    int64_t frameStart = 0, stageStart = 0;
+    const char* stageName = nullptr;
+    uint64_t frameIndex = 0, gpuDiscarded = 0;
+    GLuint queries[GPU_QUERY_LATENCY][MAX_GPU_PASSES] = {};
+    GpuPass gpuPasses[GPU_QUERY_LATENCY][MAX_GPU_PASSES] = {};
+    unsigned int gpuPassCount[GPU_QUERY_LATENCY] = {};
+    std::deque<Series> allSeries;  // deque: referências continuam válidas ao crescer
+    std::vector<TraceEvent> traceEvents;
+};
+
+// ---- Trilhas de câmera e benchmark determinístico ----
+
+// Trilha padrão do benchmark: uma volta em 4 s, subindo e descendo, com uma aproximação até metade da
+// distância inicial (nas redes grandes a câmera entra no cristal e o culling passa a cortar de verdade)
+const char* CAMERA_ORBIT_TRACK =
+    "# tempo yaw pitch distancia\n"
+    "0 -90 0 1\n"
+    "1 0 25 0.75\n"
+    "2 90 0 0.5\n"
+    "3 180 -25 0.75\n"
+    "4 270 0 1\n";
+
+// Tempo em segundos, yaw e pitch em graus e distância como fração do enquadramento inicial da cena,
+// para que a mesma trilha sirva para um átomo ou para uma rede inteira
+struct CameraKey {
+    float time, yaw, pitch, distance;
+};
+
+// Câmera gravada ou roteirizada: quadros-chave interpolados linearmente, parados nas pontas
+class CameraTrack {
+public:
+    // Uma chave "tempo yaw pitch distancia" por linha ('#' inicia comentário); os tempos precisam crescer
+    bool load(std::istream& in, std::ostream& errors) {
+        keys.clear();
+        std::string line;
+        while (std::getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            std::stringstream fields(line);
+            CameraKey key;
+            if (!(fields >> key.time)) continue; // linha vazia
+            if (!(fields >> key.yaw >> key.pitch >> key.distance) || key.distance <= 0.0f ||
+                (!keys.empty() && key.time <= keys.back().time)) {
+                errors << "Camera: chave invalida '" << line << "'\n";
+                return false;
+            }
+            keys.push_back(key);
+        }
+        if (keys.empty()) errors << "Camera: nenhuma chave\n";
+        return !keys.empty();
+    }
+
+    bool save(std::ostream& out) const {
+        out << "# tempo yaw pitch distancia\n";
+        for (const CameraKey& key : keys)
+            out << key.time << " " << key.yaw << " " << key.pitch << " " << key.distance << "\n";
+        return bool(out);
+    }
+
+    // Gravação: uma chave por frame, ignorando as que não avançam no tempo
+    void record(const CameraKey& key) {
+        if (keys.empty() || key.time > keys.back().time) keys.push_back(key);
+    }
+
+    CameraKey sample(float time) const {
+        auto next = std::upper_bound(keys.begin(), keys.end(), time,
+                                     [](float t, const CameraKey& key) { return t < key.time; });
+        if (next == keys.begin()) return keys.front();
+        if (next == keys.end()) return keys.back();
+        const CameraKey& a = *(next - 1);
+        const CameraKey& b = *next;
+        float t = (time - a.time) / (b.time - a.time);
+        return { time, glm::mix(a.yaw, b.yaw, t), glm::mix(a.pitch, b.pitch, t), glm::mix(a.distance, b.distance, t) };
+    }
+
+    bool empty() const { return keys.empty(); }
+
+private:
+    std::vector<CameraKey> keys;
+};
+
+// Quadros iniciais fora das medidas (caches, compilação tardia de shaders no driver, primeiro upload)
+const unsigned int BENCH_WARMUP_FRAMES = 5;
+
+// Resultado de uma execução com --json
+// Texto para dentro de uma string JSON: cena e câmera podem trazer caminhos (barras invertidas no Windows, aspas)
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)c < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", (unsigned int)c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+struct BenchRun {
+    std::string scene, sphere, camera, upload;
+    size_t atoms = 0, electrons = 0;
+    unsigned int width = 0, height = 0, frames = 0, fps = 0, threads = 0;
+    std::vector<float> frameMs;                               // quadros depois do aquecimento
+    uint64_t drawCalls = 0, triangles = 0, uploadBytes = 0;   // somados nos mesmos quadros
+    double fenceWaitMs = 0.0;
+    double firstFrameMs = 0.0;                                // do início do processo ao fim do primeiro quadro
+    unsigned int shadersFromDisk = 0, shadersCompiled = 0;
+    std::vector<std::pair<unsigned int, uint32_t>> checksums; // quadro e CRC-32 dos pixels RGBA
+
+    void writeJson(std::ostream& out) const {
+        double seconds = 0.0, worst = 0.0;
+        for (float ms : frameMs) {
+            seconds += ms * 1e-3;
+            worst = std::max(worst, (double)ms);
+        }
+        size_t measured = std::max<size_t>(1, frameMs.size());
+        // Cena e câmera podem ser caminhos longos: vão direto para o stream, sem passar pelo buffer
+        char text[768];
+        std::snprintf(text, sizeof(text), "\",\"atomos\":%zu,\"eletrons\":%zu,\"esfera\":\"%s\",\"camera\":\"", atoms, electrons,
+                      jsonEscape(sphere).c_str());
+        out << "{\"cena\":\"" << jsonEscape(scene) << text << jsonEscape(camera) << "\",";
+        std::snprintf(text, sizeof(text),
+                      "\"resolucao\":[%u,%u],\"quadros\":%u,\"fps_animacao\":%u,\"threads\":%u,\"simd\":\"%s\","
+                      "\"quadros_medidos\":%zu,\"frame_ms\":{\"media\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f},"
+                      "\"draw_calls_por_quadro\":%.2f,\"triangulos_por_quadro\":%.0f,\"triangulos_por_segundo\":%.0f,"
+                      "\"upload\":\"%s\",\"upload_bytes_por_quadro\":%.0f,\"espera_cercas_ms_por_quadro\":%.4f,"
+                      "\"primeiro_quadro_ms\":%.2f,\"shaders_do_cache\":%u,\"shaders_compilados\":%u,",
+                      width, height, frames, fps, threads, jsonEscape(simdLevelName(activeSimdLevel)).c_str(), frameMs.size(), seconds * 1e3 / measured,
+                      samplePercentile(frameMs, 0.50f), samplePercentile(frameMs, 0.95f), samplePercentile(frameMs, 0.99f),
+                      worst, (double)drawCalls / measured, (double)triangles / measured, seconds > 0.0 ? triangles / seconds : 0.0,
+                      jsonEscape(upload).c_str(), (double)uploadBytes / measured, fenceWaitMs / measured, firstFrameMs, shadersFromDisk,
+                      shadersCompiled);
+        out << text << "\"checksums\":{";
+        for (size_t i = 0; i < checksums.size(); ++i) {
+            std::snprintf(text, sizeof(text), "%s\"%u\":\"%08x\"", i ? "," : "", checksums[i].first, checksums[i].second);
+            out << text;
+        }
+        out << "}}";
+    }
+};
+
+// Aspas para a linha de comando (os caminhos usados aqui não têm aspas)
+std::string quoteArgument(const std::string& argument) {
+    return "\"" + argument + "\"";
+}
+
+// --bench-cenas: roda cada combinação de cena e esfera num processo novo (contexto, driver e memória limpos a
+// cada medida), sem janela e com a mesma trilha de câmera, e junta os objetos JSON de cada um num array.
+// As redes dobram de tamanho até maxLattice; o padrão (8) ainda cabe num driver por software no CI.
+int runSceneSweep(const std::string& self, const std::string& commonArgs, unsigned int maxLattice, std::ostream& out) {
+    std::vector<std::string> scenes = { "" };
+    for (unsigned int n : { 2u, 4u, 8u, 16u, 32u, 47u })
+        if (n < maxLattice) scenes.push_back("--rede " + std::to_string(n));
+    scenes.push_back("--rede " + std::to_string(maxLattice));
+    const char* spheres[] = { "--esfera 40", "--esfera 10", "", "--impostores" }; // "" = nível de detalhe por átomo
+
+    int result = 0;
+    bool first = true;
+    out << "[\n";
+    for (const std::string& scene : scenes) {
+        for (const char* sphere : spheres) {
+            std::string command = quoteArgument(self) + " --headless --json - " + commonArgs + " " + scene + " " + sphere;
+            std::cerr << "bench-cenas: " << command << std::endl;
+#ifdef _WIN32
+            // O cmd.exe tira o primeiro par de aspas da linha inteira
+            FILE* child = _popen(("\"" + command + "\"").c_str(), "r");
+#else
+            FILE* child = popen(command.c_str(), "r");
+#endif
+            std::string json;
+            char buffer[4096];
+            while (child && std::fgets(buffer, sizeof(buffer), child)) json += buffer;
+#ifdef _WIN32
+            int status = child ? _pclose(child) : -1;
+#else
+            int status = child ? pclose(child) : -1;
+#endif
+            while (!json.empty() && std::isspace((unsigned char)json.back())) json.pop_back();
+            if (status != 0 || json.empty() || json[0] != '{') {
+                std::cerr << "bench-cenas: falhou (" << status << ")" << std::endl;
+                result = 1;
+                continue;
+            }
+            out << (first ? "" : ",\n") << json;
+            first = false;
+        }
+    }
+    out << "\n]\n";
+    return out ? result : 1;
+}
+
+// Compara o desenho instanciado com o antigo (imagem e tempo de frame) para 5, 1k e 100k elétrons.
+// Roda numa janela oculta; com Mesa llvmpipe dá para usar em máquinas sem GPU.
+int runElectronBenchmark(GLFWwindow* window, const ShaderProgram& shaderProgram, const ShaderProgram& instancedProgram,
+                         unsigned int frameUBO, unsigned int vao, unsigned int instanceVBO, const MeshHandle& sphere) {
+    glm::vec3 cameraPos(0.0f, 0.0f, cameraDistance);
+    glm::mat4 view = glm::lookAt(cameraPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(SCR_WIDTH) / SCR_HEIGHT, 0.1f, 100.0f);
+    updateFrameUniforms(frameUBO, view, projection, cameraPos, 0.0f);
+
+    RenderQueue queue;
+    std::vector<ElectronInstance> instances;
+    auto drawFrame = [&](bool instanced) {
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (instanced)
+            queueElectronsInstanced(queue, instancedProgram, vao, instanceVBO, instances, sphere);
+        else
+            queueElectronsLegacy(queue, shaderProgram, vao, instances, sphere);
+        queue.submit();
+        glFinish();
+    };
+
+    // Os dois caminhos precisam gerar exatamente a mesma imagem
+    std::vector<unsigned char> legacyPixels(SCR_WIDTH * SCR_HEIGHT * 4), instancedPixels(SCR_WIDTH * SCR_HEIGHT * 4);
+    buildElectronInstances(instances, 5, 1.0f);
+    drawFrame(false);
+    glReadPixels(0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, legacyPixels.data());
+    drawFrame(true);
+    glReadPixels(0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, instancedPixels.data());
+    bool identical = legacyPixels == instancedPixels;
+
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << "\n";
+    std::cout << "Imagens (antigo x instanciado, 5 eletrons): " << (identical ? "identicas" : "DIFERENTES") << std::endl;
+    std::cout << "eletrons   antigo (ms/frame)   instanciado (ms/frame)   draws (antigo/instanciado)\n";
+
+    const size_t counts[] = { 5, 1000, 100000 };
+    for (size_t count : counts) {
+        double msPerFrame[2];
+        unsigned int drawCalls[2];
+        for (int instanced = 0; instanced < 2; ++instanced) {
+            // Um frame de aquecimento, depois mede até ~2 s (no mínimo 1, no máximo 50 frames)
+            buildElectronInstances(instances, count, 0.0f);
+            drawFrame(instanced);
+            int frames = 0;
+            auto start = std::chrono::steady_clock::now();
+            double elapsed = 0.0;
+            while (frames < 50 && (frames == 0 || elapsed < 2.0)) {
+                buildElectronInstances(instances, count, frames * 0.016f);
+                drawFrame(instanced);
+                ++frames;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            msPerFrame[instanced] = elapsed * 1000.0 / frames;
+            drawCalls[instanced] = queue.stats.drawCalls;
+        }
+        std::cout << count << "\t   " << msPerFrame[0] << "\t\t       " << msPerFrame[1]
+                  << "\t\t\t" << drawCalls[0] << "/" << drawCalls[1] << std::endl;
+    }
+    glfwSwapBuffers(window);
+    return identical ? 0 : 1;
+}
+
+// ---- Entrada: fila sem trava entre a thread de eventos e a de render ----
+
+// Fila de um produtor e um consumidor, sem trava: cada lado só escreve o próprio índice, e o par
+// release/acquire garante que o item já está no anel quando o consumidor enxerga o índice novo
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "a capacidade precisa ser uma potência de 2");
+
+public:
+    // false com a fila cheia (o item é descartado)
+    bool push(const T& item) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity) return false;
+        items[tail & (Capacity - 1)] = item;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) return false;
+        item = items[head & (Capacity - 1)];
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> items;
+    alignas(64) std::atomic<size_t> headIndex{ 0 }; // só o consumidor escreve
+    alignas(64) std::atomic<size_t> tailIndex{ 0 }; // só o produtor escreve
+};
+
+// Evento do GLFW como chegou, com o instante em que o callback rodou
+struct InputEvent {
+    enum Type : uint8_t { CursorMove, MouseButton, Scroll, Key } type;
+    int code;     // botão ou tecla
+    int action;   // GLFW_PRESS, GLFW_RELEASE ou GLFW_REPEAT
+    double x, y;  // posição do cursor ou deslocamento da rolagem
+    int64_t time; // ns do steady_clock
+};
+
+// Os callbacks só enfileiram; a câmera e os modos mudam na thread de render, em applyPendingInput(),
+// logo antes de a câmera ser usada. Assim nenhum global é escrito por duas threads.
+SpscQueue<InputEvent, 4096> inputQueue;
+std::atomic<unsigned int> droppedInputEvents{ 0 };
+
+int64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void queueInput(InputEvent::Type type, int code, int action, double x, double y) {
+    if (!inputQueue.push({ type, code, action, x, y, steadyNanoseconds() })) ++droppedInputEvents;
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+    queueInput(InputEvent::Scroll, 0, 0, xoffset, yoffset);
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    queueInput(InputEvent::MouseButton, button, action, 0.0, 0.0);
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    queueInput(InputEvent::Key, key, action, 0.0, 0.0);
+}
+
+void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
+    queueInput(InputEvent::CursorMove, 0, 0, xpos, ypos);
+}
+
+void applyInputEvent(const InputEvent& event) {
+    switch (event.type) {
+    case InputEvent::Scroll:
+        cameraDistance -= (float)event.y * 0.5f;
+        if (cameraDistance < 1.0f) cameraDistance = 1.0f;
+        if (cameraDistance > maxCameraDistance) cameraDistance = maxCameraDistance;
+        break;
+    case InputEvent::MouseButton:
+        if (event.code == GLFW_MOUSE_BUTTON_LEFT) {
+            if (event.action == GLFW_PRESS)
+                mousePressed = true;
+            else if (event.action == GLFW_RELEASE)
+                mousePressed = false;
+        }
+        break;
+    case InputEvent::Key:
+        if (event.code == GLFW_KEY_I && event.action == GLFW_PRESS) sphereImpostors = !sphereImpostors;
+        if (event.code == GLFW_KEY_O && event.action == GLFW_PRESS) ++orbitalSelection;
+        if (event.code == GLFW_KEY_SPACE && event.action == GLFW_PRESS) playbackPaused = !playbackPaused;
+        if ((event.code == GLFW_KEY_LEFT || event.code == GLFW_KEY_RIGHT) && event.action != GLFW_RELEASE)
+            playbackSeek += event.code == GLFW_KEY_RIGHT ? 1 : -1;
+        break;
+    case InputEvent::CursorMove: {
+        if (!mousePressed) {
+            firstMouse = true;
+            break;
+        }
+
+        if (firstMouse) {
+            lastX = event.x;
+            lastY = event.y;
+            firstMouse = false;
+        }
+
+        float xoffset = event.x - lastX;
+        float yoffset = lastY - event.y; // invertido: y para cima é positivo
+        lastX = event.x;
+        lastY = event.y;
+
+        float sensitivity = 0.1f;
+        xoffset *= sensitivity;
+        yoffset *= sensitivity;
+
+        yaw += xoffset;
+        pitch += yoffset;
+
+        // Limitar pitch para evitar "flipping"
+        if (pitch > 89.0f) pitch = 89.0f;
+        if (pitch < -89.0f) pitch = -89.0f;
+        break;
+    }
+    }
+}
+
+// Aplica os eventos pendentes; devolve o instante do mais antigo (0 se não havia nenhum)
+int64_t applyPendingInput() {
+    InputEvent event;
+    int64_t oldest = 0;
+    while (inputQueue.pop(event)) {
+        if (!oldest) oldest = event.time;
+        applyInputEvent(event);
+    }
+    return oldest;
+}
+
+// Latência da entrada até a tela, nos quadros que aplicaram algum evento: do evento mais antigo até a câmera
+// ser lida (tempo na fila) e daí até glfwSwapBuffers voltar com o quadro. O swap volta quando o quadro foi
+// entregue ao compositor, então é um limite inferior. Sem a thread de eventos, o tempo que o evento passou na
+// fila do sistema até glfwPollEvents não é visível, e a fila aparece vazia.
+struct InputLatency {
+    std::vector<float> total, queued; // ms
+    int64_t eventTime = 0, sampleTime = 0;
+
+    // Logo depois de aplicar a entrada do quadro (oldestEvent = 0 se não havia nenhum evento)
+    void sampled(int64_t oldestEvent) {
+        eventTime = oldestEvent;
+        sampleTime = steadyNanoseconds();
+    }
+
+    // Logo depois do swap
+    void presented() {
+        if (!eventTime) return;
+        total.push_back((steadyNanoseconds() - eventTime) * 1e-6f);
+        queued.push_back((sampleTime - eventTime) * 1e-6f);
+        eventTime = 0;
+    }
+
+    void report(std::ostream& out, const char* mode) const {
+        if (total.empty()) return;
+        char text[320];
+        std::snprintf(text, sizeof(text), "Latencia entrada -> tela (%s): %zu quadros com entrada, p50 %.2f ms, p95 %.2f ms, "
+                      "p99 %.2f ms, max %.2f ms (na fila: p50 %.2f ms, p95 %.2f ms), %u eventos descartados", mode, total.size(),
+                      samplePercentile(total, 0.50f), samplePercentile(total, 0.95f), samplePercentile(total, 0.99f),
+                      *std::max_element(total.begin(), total.end()), samplePercentile(queued, 0.50f),
+                      samplePercentile(queued, 0.95f), droppedInputEvents.load());
+        out << text << std::endl;
+    }
+};
+
+// Título pedido pela thread de render; glfwSetWindowTitle só pode ser chamado pela thread principal
+struct PendingTitle {
+    std::mutex mutex;
+    std::string text;
+    bool changed = false;
+
+    void set(const std::string& title) {
+        std::lock_guard<std::mutex> lock(mutex);
+        text = title;
+        changed = true;
+    }
+
+    void apply(GLFWwindow* window) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (changed) glfwSetWindowTitle(window, text.c_str());
+        changed = false;
+    }
+};
+
+int main(int argc, char** argv) {
+    // --bench-eletrons: compara o desenho instanciado com o antigo e sai
+    // --estatisticas: imprime draw calls e trocas de estado uma vez por segundo
+    // --icosfera: usa uma icosfera no lugar da esfera UV 40x40
+    // --esfera N: esfera UV NxN para todos os átomos (40, 20 e 10 vêm prontas do compilador; outras são geradas
+    //            na hora). Sem --esfera, cada átomo usa 40x40, 20x20 ou 10x10 conforme o tamanho na tela.
+    // --elemento Z|Símbolo: átomo com a distribuição eletrônica do elemento (ex.: --elemento 26, --elemento U)
+    // --molecula agua|co2|metano: molécula embutida
+    // --xyz arquivo: átomos lidos de um arquivo XYZ
+    // --tabela arquivo: tabela periódica alternativa (mesmo formato de ELEMENT_TABLE)
+    // --teste-esferas: confere as esferas constexpr (40x40, 20x20, 10x10) contra generateSphere e sai (1 se diferirem)
+    // --bench-simd: compara o kernel em lote dos elétrons com o glm (não abre janela) e sai
+    // --simd escalar|sse2|avx2: força um nível do kernel (o padrão é o maior suportado)
+    // --rede N: rede cristalina de NaCl com N x N x N átomos
+    // --threads N: threads da simulação, contando a principal (o padrão é uma por núcleo)
+    // --bench-threads: mede o passo da rede (--rede, padrão 47, ~100 mil átomos) com 1..--threads threads e sai
+    // --bench-culling: confere e mede o culling da BVH numa rede (--rede, padrão 47) e sai
+    // --headless: renderiza sem janela (EGL ou OSMesa) um número fixo de quadros e mostra os quadros por segundo
+    //   --resolucao LxA (padrão 1920x1080), --quadros N (padrão 120), --fps N (tempo da animação, padrão 30)
+    //   --saida arquivo|- e --formato raw|y4m|png (pela extensão, se omitido): grava os quadros
+    // --perfil: percentis do tempo de cada etapa (CPU) e passo (GPU) no terminal e no título, uma vez por segundo
+    // --trace arquivo.json: grava as etapas e passos de cada frame no formato do chrome://tracing ao sair
+    // --camera arquivo|orbita: câmera pela trilha (em vez do mouse); --gravar-camera arquivo: grava a do mouse ao sair
+    // --json arquivo|-: com --headless, tempos por quadro, draw calls, triângulos e CRC-32 de alguns quadros
+    //   (--checksum-quadros 0,60,119; o padrão é o primeiro, o do meio e o último)
+    // --impostores: esferas desenhadas como impostores (quadrado + interseção raio-esfera); a tecla I alterna
+    // --orbital n,l,m: nuvem de probabilidade |ψ|² do orbital hidrogenoide (pode repetir; a tecla O alterna),
+    //   com Z de --elemento (padrão 1) e --pontos N amostras (padrão 1 milhão)
+    // --upload coerente|flush|orfao: anel persistente coerente (padrão), com flush explícito, ou glBufferSubData
+    // --gravar-trajetoria arquivo.trj: grava as posições de núcleos e elétrons de cada frame (numa thread de escrita)
+    // --trajetoria arquivo.trj: reproduz uma gravação no lugar da simulação (espaço pausa, setas avançam e voltam)
+    // --bench-cenas: benchmark sem janela de várias cenas (até --rede, padrão 8) com esferas 40x40, 10x10,
+    //   por nível de detalhe e impostores, na trilha orbita (ou --camera), em 640x360 (ou --resolucao);
+    //   JSON em --json ou na saída padrão
+    // --cache-shaders pasta|nenhum: onde guardar os binários dos shaders (padrão ~/.cache/atomo/shaders ou
+    //   %LOCALAPPDATA%\atomo\shaders); com --estatisticas, --perfil ou --headless mostra o tempo até o primeiro quadro
+    // --thread-unica: eventos e render na thread principal (sem a thread de render), para comparar a latência
+    //   da entrada, que --estatisticas e --perfil mostram ao sair
+    bool electronBenchmark = false;
+    bool printStats = false;
+    bool useIcosphere = false;
+    unsigned int sphereResolution = 0; // 0 = nível de detalhe por átomo
+    std::string elementName, moleculeName, xyzPath, tablePath;
+    bool simdBenchmark = false;
+    bool sphereTest = false;
+    bool threadBenchmark = false;
+    bool cullingBenchmark = false;
+    bool headless = false;
+    unsigned int headlessWidth = 1920, headlessHeight = 1080, frameCount = 120, fps = 30;
+    std::string outputPath, formatName;
+    bool profileHud = false;
+    std::string tracePath;
+    std::string cameraPath, cameraRecordPath, jsonPath;
+    std::vector<unsigned int> checksumFrames;
+    bool sceneSweep = false, resolutionGiven = false;
+    std::string simdName;
+    StreamMode streamMode = StreamMode::Coherent;
+    std::vector<OrbitalKey> orbitals;
+    size_t cloudPoints = 1000000;
+    std::string trajectoryPath, trajectoryRecordPath;
+    std::string shaderCacheDirectory = defaultShaderCacheDirectory();
+    bool singleThread = false;
+    unsigned int latticeSize = 0;
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--bench-eletrons") == 0) electronBenchmark = true;
+        else if (std::strcmp(argv[i], "--estatisticas") == 0) printStats = true;
+        else if (std::strcmp(argv[i], "--icosfera") == 0) useIcosphere = true;
+        else if (std::strcmp(argv[i], "--esfera") == 0 && i + 1 < argc) sphereResolution = std::max(3, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--elemento") == 0 && i + 1 < argc) elementName = argv[++i];
+        else if (std::strcmp(argv[i], "--molecula") == 0 && i + 1 < argc) moleculeName = argv[++i];
+        else if (std::strcmp(argv[i], "--xyz") == 0 && i + 1 < argc) xyzPath = argv[++i];
+        else if (std::strcmp(argv[i], "--tabela") == 0 && i + 1 < argc) tablePath = argv[++i];
+        else if (std::strcmp(argv[i], "--bench-simd") == 0) simdBenchmark = true;
+        else if (std::strcmp(argv[i], "--teste-esferas") == 0) sphereTest = true;
+        else if (std::strcmp(argv[i], "--bench-threads") == 0) threadBenchmark = true;
+        else if (std::strcmp(argv[i], "--bench-culling") == 0) cullingBenchmark = true;
+        else if (std::strcmp(argv[i], "--headless") == 0) headless = true;
+        else if (std::strcmp(argv[i], "--resolucao") == 0 && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%ux%u", &headlessWidth, &headlessHeight) != 2 || !headlessWidth || !headlessHeight) {
+                std::cerr << "Resolucao invalida: " << argv[i] << " (use LxA, ex.: 3840x2160)" << std::endl;
+                return -1;
+            }
+            resolutionGiven = true;
+        }
+        else if (std::strcmp(argv[i], "--quadros") == 0 && i + 1 < argc) frameCount = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) fps = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--saida") == 0 && i + 1 < argc) outputPath = argv[++i];
+        else if (std::strcmp(argv[i], "--formato") == 0 && i + 1 < argc) formatName = argv[++i];
+        else if (std::strcmp(argv[i], "--perfil") == 0) profileHud = true;
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+        else if (std::strcmp(argv[i], "--camera") == 0 && i + 1 < argc) cameraPath = argv[++i];
+        else if (std::strcmp(argv[i], "--gravar-camera") == 0 && i + 1 < argc) cameraRecordPath = argv[++i];
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) jsonPath = argv[++i];
+        else if (std::strcmp(argv[i], "--checksum-quadros") == 0 && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) checksumFrames.push_back((unsigned int)std::atoi(item.c_str()));
+        }
+        else if (std::strcmp(argv[i], "--bench-cenas") == 0) sceneSweep = true;
+        else if (std::strcmp(argv[i], "--impostores") == 0) sphereImpostors = true;
+        else if (std::strcmp(argv[i], "--orbital") == 0 && i + 1 < argc) {
+            OrbitalKey key = {};
+            if (!parseOrbital(argv[++i], key)) {
+                std::cerr << "Orbital invalido: " << argv[i] << " (use n,l,m com 0 <= l < n e |m| <= l, ex.: 3,2,0)" << std::endl;
+                return -1;
+            }
+            orbitals.push_back(key);
+        }
+        else if (std::strcmp(argv[i], "--pontos") == 0 && i + 1 < argc) cloudPoints = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--trajetoria") == 0 && i + 1 < argc) trajectoryPath = argv[++i];
+        else if (std::strcmp(argv[i], "--gravar-trajetoria") == 0 && i + 1 < argc) trajectoryRecordPath = argv[++i];
+        else if (std::strcmp(argv[i], "--thread-unica") == 0) singleThread = true;
+        else if (std::strcmp(argv[i], "--cache-shaders") == 0 && i + 1 < argc) {
+            shaderCacheDirectory = argv[++i];
+            if (shaderCacheDirectory == "nenhum") shaderCacheDirectory.clear();
+        }
+        else if (std::strcmp(argv[i], "--upload") == 0 && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "coerente") streamMode = StreamMode::Coherent;
+            else if (mode == "flush") streamMode = StreamMode::Flush;
+            else if (mode == "orfao") streamMode = StreamMode::Orphan;
+            else std::cerr << "Modo de upload desconhecido: " << mode << " (use coerente, flush ou orfao)" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--rede") == 0 && i + 1 < argc) latticeSize = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threadCount = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            std::string level = simdName = argv[++i];
+            if (level == "escalar") activeSimdLevel = SimdLevel::Scalar;
+            else if (level == "sse2" && detectSimdLevel() != SimdLevel::Scalar) activeSimdLevel = SimdLevel::SSE2;
+            else if (level == "avx2" && detectSimdLevel() == SimdLevel::AVX2) activeSimdLevel = SimdLevel::AVX2;
+            else std::cerr << "Nivel SIMD indisponivel: " << level << ", usando " << simdLevelName(activeSimdLevel) << std::endl;
+        }
+    }
+    if (simdBenchmark) return runSimdBenchmark();
+    if (sphereTest) return runSphereTest();
+
+    // Cena: o átomo clássico por padrão, ou o que foi pedido na linha de comando
+    ElementTable elementTable;
+    std::istringstream embeddedTable(ELEMENT_TABLE);
+    elementTable.load(embeddedTable, std::cerr);
+    if (!tablePath.empty()) {
+        std::ifstream tableFile(tablePath);
+        if (!tableFile || !elementTable.load(tableFile, std::cerr)) {
+            std::cerr << "Erro ao ler a tabela " << tablePath << std::endl;
+            return -1;
+        }
+    }
+    if (threadBenchmark) return runThreadBenchmark(elementTable, latticeSize ? latticeSize : 47, threadCount);
+    if (cullingBenchmark) return runCullingBenchmark(elementTable, latticeSize ? latticeSize : 47);
+    if (sceneSweep) {
+        std::string commonArgs = "--resolucao " + (resolutionGiven ? std::to_string(headlessWidth) + "x" + std::to_string(headlessHeight) : "640x360") +
+                                 " --quadros " + std::to_string(frameCount) + " --fps " + std::to_string(fps) +
+                                 " --threads " + std::to_string(threadCount) +
+                                 " --camera " + quoteArgument(cameraPath.empty() ? "orbita" : cameraPath);
+        if (!tablePath.empty()) commonArgs += " --tabela " + quoteArgument(tablePath);
+        // Todas as linhas usam o mesmo cache de shaders (o desta execução), senão só a primeira o encontraria frio
+        commonArgs += " --cache-shaders " + quoteArgument(shaderCacheDirectory.empty() ? "nenhum" : shaderCacheDirectory);
+        commonArgs += " --upload " + std::string(streamModeName(streamMode));
+        if (!simdName.empty()) commonArgs += " --simd " + simdName;
+        if (!checksumFrames.empty()) {
+            commonArgs += " --checksum-quadros ";
+            for (size_t i = 0; i < checksumFrames.size(); ++i) commonArgs += (i ? "," : "") + std::to_string(checksumFrames[i]);
+        }
+        std::ofstream jsonFile;
+        if (!jsonPath.empty() && jsonPath != "-") jsonFile.open(jsonPath);
+        std::ostream& out = jsonFile.is_open() ? jsonFile : std::cout;
+        return runSceneSweep(argv[0], commonArgs, latticeSize ? latticeSize : 8, out);
+    }
+
+    // Com os quadros ou o JSON indo para a saída padrão, as estatísticas não podem ir para lá também
+    if (headless && outputPath == "-" && jsonPath == "-") {
+        std::cerr << "--saida - e --json - nao podem dividir a saida padrao" << std::endl;
+        return -1;
+    }
+    if (headless && (outputPath == "-" || jsonPath == "-")) printStats = false;
+    // Sem janela não há eventos, e o benchmark dos elétrons desenha sozinho
+    const bool eventThread = !singleThread && !headless && !electronBenchmark;
+
+    CameraTrack cameraTrack;
+    if (!cameraPath.empty()) {
+        std::ifstream cameraFile;
+        std::istringstream orbit(CAMERA_ORBIT_TRACK);
+        std::istream* track = &orbit;
+        if (cameraPath != "orbita") {
+            cameraFile.open(cameraPath);
+            track = &cameraFile;
+        }
+        if (!*track || !cameraTrack.load(*track, std::cerr)) {
+            std::cerr << "Erro ao ler a trilha de camera " << cameraPath << std::endl;
+            return -1;
+        }
+    }
+
+    // Reprodução: a cena vem do arquivo, e não há nada para simular
+    TrajectoryReader trajectory;
+    const bool playback = !trajectoryPath.empty();
+    if (playback) {
+        if (!trajectoryRecordPath.empty()) {
+            std::cerr << "--trajetoria e --gravar-trajetoria nao podem ser usados juntos" << std::endl;
+            return -1;
+        }
+        if (!trajectory.open(trajectoryPath, std::cerr)) return -1;
+        orbitals.clear();
+    }
+
+    FrameFormat frameFormat = FrameFormat::Raw;
+    if (formatName.empty() && outputPath.size() > 4)
+        formatName = outputPath.substr(outputPath.size() - 3);
+    if (formatName == "y4m") frameFormat = FrameFormat::Y4M;
+    else if (formatName == "png") frameFormat = FrameFormat::PNG;
+
+    // A janela abre antes de qualquer outra coisa: a cena e as malhas são montadas numa thread
+    // enquanto o driver compila os shaders, e a janela já mostra quadros nesse meio-tempo.
+    // Sem janela: na plataforma nula do GLFW 3.4 o contexto vem do EGL (ou OSMesa), sem servidor gráfico
+#ifdef GLFW_PLATFORM_NULL
+    if (headless) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (!glfwInit()) return -1;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (electronBenchmark || headless) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef GLFW_PLATFORM_NULL
+    if (headless) glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#endif
+
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Átomo", nullptr, nullptr);
+#ifdef GLFW_PLATFORM_NULL
+    if (!window && headless) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Átomo", nullptr, nullptr);
+    }
+#endif
+    if (!window) {
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetCursorPosCallback(window, cursor_position_callback);
+    glfwSetKeyCallback(window, key_callback);
+
+
+    glewExperimental = GL_TRUE;
+    GLenum glewStatus = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // A GLEW compilada para GLX não acha um display num contexto EGL, mas as funções já foram carregadas
+    if (headless && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY) glewStatus = GLEW_OK;
+#endif
+    if (glewStatus != GLEW_OK) return -1;
+    StartupTimes startup;
+    startup.context = millisecondsSinceStart();
+
+    // Todos os programas são pedidos já: com GL_KHR_parallel_shader_compile o driver compila em paralelo
+    // (e com o cache em disco quase nada precisa ser compilado); loadShaderProgram só pega o resultado
+    programCache.init(shaderCacheDirectory);
+    programCache.prefetch(vertexShaderSource, fragmentShaderSource);
+    programCache.prefetch(instancedVertexShaderSource, fragmentShaderSource);
+    programCache.prefetch(impostorVertexShaderSource, impostorFragmentShaderSource);
+    programCache.prefetch(orbitVertexShaderSource, orbitFragmentShaderSource);
+    if (!orbitals.empty()) programCache.prefetch(cloudVertexShaderSource, cloudFragmentShaderSource);
+    if (playback) {
+        programCache.prefetch(trajectoryVertexShaderSource, fragmentShaderSource);
+        programCache.prefetch(trajectoryImpostorVertexShaderSource, impostorFragmentShaderSource);
+    }
+
+    glEnable(GL_DEPTH_TEST);
+
+    unsigned int viewportWidth = SCR_WIDTH, viewportHeight = SCR_HEIGHT;
+    OffscreenTarget offscreen;
+    FrameWriter writer;
+    bool writing = headless && !outputPath.empty();
+    if (headless) {
+        viewportWidth = headlessWidth;
+        viewportHeight = headlessHeight;
+        if (!offscreen.init(viewportWidth, viewportHeight)) {
+            std::cerr << "Nao foi possivel criar o framebuffer de " << viewportWidth << "x" << viewportHeight << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        if (writing && !writer.open(frameFormat, outputPath, viewportWidth, viewportHeight, fps)) {
+            std::cerr << "Nao foi possivel gravar em " << outputPath
+                      << " (Y4M precisa de largura e altura pares; PNG precisa de um arquivo)" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwSwapInterval(0);
+        if (!jsonPath.empty()) {
+            offscreen.checksumFrames = checksumFrames;
+            if (checksumFrames.empty()) offscreen.checksumFrames = { 0, frameCount / 2, frameCount - 1 };
+        }
+    }
+
+    // Montagem da cena, sem nenhuma chamada de GL: átomos, enquadramento, primeira nuvem, malhas (na memória),
+    // BVH e órbitas. Roda na thread de carregamento; os erros ficam em sceneErrors até ela terminar.
+    Scene scene;
+    glm::vec3 sceneCenter;
+    float sceneRadius;
+    JobSystem jobs(threadCount);
+    OrbitalCloudCache cloudCache;
+    unsigned int shownOrbital = 0;
+    const OrbitalCloudCache::Cloud* firstCloud = nullptr;
+    GeometryPool geometry;
+    MeshHandle lodMeshes[LOD_LEVELS];
+    unsigned int lodLevels = 1;
+    double geometryMs = 0.0;
+    SceneCuller culler;
+    // Uma órbita por elétron, nos mesmos planos; a cena não muda de forma, então são montadas uma vez.
+    // Em redes muito grandes as órbitas só embaralhariam a imagem (e custariam 64 bytes cada).
+    const size_t MAX_ORBITS = 100000;
+    OrbitRenderer orbitRenderer;
+    std::ostringstream sceneErrors;
+    auto buildScene = [&]() -> bool {
+        if (playback) {
+            // Sem átomos: núcleos e elétrons vêm dos quadros gravados
+        } else if (!orbitals.empty()) {
+            // Nuvens de orbitais: o átomo é só o núcleo (de hidrogênio, ou do --elemento)
+            unsigned int z = elementName.empty() ? 1 : elementTable.find(elementName);
+            if (!z) {
+                sceneErrors << "Elemento desconhecido: " << elementName << std::endl;
+                return false;
+            }
+            for (OrbitalKey& key : orbitals) {
+                key.z = z;
+                key.count = cloudPoints;
+            }
+            scene.reserve(1, 0);
+            scene.addNucleus(glm::vec3(0.0f), (uint8_t)z, 0.35f + 0.08f * std::cbrt((float)z));
+        } else if (latticeSize) {
+            addRockSaltLattice(elementTable, latticeSize, scene);
+        } else if (!elementName.empty()) {
+            unsigned int z = elementTable.find(elementName);
+            if (!z) {
+                sceneErrors << "Elemento desconhecido: " << elementName << std::endl;
+                return false;
+            }
+            scene.reserve(1, z);
+            scene.addAtom(elementTable[z], z, glm::vec3(0.0f));
+        } else if (!moleculeName.empty() || !xyzPath.empty()) {
+            std::ifstream xyzFile;
+            std::istringstream molecule;
+            std::istream* xyz = &molecule;
+            if (!xyzPath.empty()) {
+                xyzFile.open(xyzPath);
+                xyz = &xyzFile;
+            } else if (moleculeName == "agua") molecule.str(MOLECULE_WATER);
+            else if (moleculeName == "co2") molecule.str(MOLECULE_CO2);
+            else if (moleculeName == "metano") molecule.str(MOLECULE_METHANE);
+            else {
+                sceneErrors << "Molecula desconhecida: " << moleculeName << " (use agua, co2 ou metano)" << std::endl;
+                return false;
+            }
+            if (!*xyz || !loadXYZ(*xyz, elementTable, scene, sceneErrors)) {
+                sceneErrors << "Erro ao ler " << (xyzPath.empty() ? moleculeName : xyzPath) << std::endl;
+                return false;
+            }
+        } else {
+            scene.reserve(1, 5);
+            scene.addClassicAtom(glm::vec3(0.0f));
+        }
+        if (printStats)
+            std::cout << "Cena: " << scene.atomCount() << " atomos, " << scene.electronCount() << " eletrons\n";
+
+        // Câmera centrada na cena, com zoom e plano distante que cabem nela
+        scene.bounds(sceneCenter, sceneRadius);
+        if (playback) {
+            sceneCenter = trajectory.center();
+            sceneRadius = trajectory.radius();
+        }
+
+        // A primeira nuvem é amostrada já aqui, nas threads da simulação, para o enquadramento caber nela
+        if (!orbitals.empty()) {
+            firstCloud = &cloudCache.get(orbitals[0], jobs);
+            reportOrbitalCloud(std::cerr, cloudCache, *firstCloud, threadCount);
+            sceneRadius = std::max(sceneRadius, firstCloud->radius);
+        }
+
+        // Todas as malhas (níveis de detalhe da esfera) num único pool de geometria; o upload fica para a thread do contexto
+        auto geometryStart = std::chrono::steady_clock::now();
+        if (useIcosphere || (sphereResolution && sphereResolution != 40 && sphereResolution != 20 && sphereResolution != 10)) {
+            std::vector<Vertex> sphereVertices;
+            std::vector<unsigned int> sphereIndices;
+            std::string name;
+            if (useIcosphere) {
+                generateIcosphere(sphereVertices, sphereIndices, 3);
+                name = "icosfera (3 subdivisoes)";
+            } else {
+                generateSphere(sphereVertices, sphereIndices, sphereResolution, sphereResolution);
+                name = "esfera UV " + std::to_string(sphereResolution) + "x" + std::to_string(sphereResolution);
+            }
+            lodMeshes[0] = geometry.addTriangles(name.c_str(), std::move(sphereVertices), std::move(sphereIndices));
+        } else if (sphereResolution == 0) {
+            lodMeshes[0] = geometry.addPrebuiltTriangles("esfera UV 40x40", SPHERE_LOD0.vertices, SPHERE_LOD0.indices);
+            lodMeshes[1] = geometry.addPrebuiltTriangles("esfera UV 20x20", SPHERE_LOD1.vertices, SPHERE_LOD1.indices);
+            lodMeshes[2] = geometry.addPrebuiltTriangles("esfera UV 10x10", SPHERE_LOD2.vertices, SPHERE_LOD2.indices);
+            lodLevels = LOD_LEVELS;
+        } else if (sphereResolution == 40) {
+            lodMeshes[0] = geometry.addPrebuiltTriangles("esfera UV 40x40", SPHERE_LOD0.vertices, SPHERE_LOD0.indices);
+        } else if (sphereResolution == 20) {
+            lodMeshes[0] = geometry.addPrebuiltTriangles("esfera UV 20x20", SPHERE_LOD1.vertices, SPHERE_LOD1.indices);
+        } else {
+            lodMeshes[0] = geometry.addPrebuiltTriangles("esfera UV 10x10", SPHERE_LOD2.vertices, SPHERE_LOD2.indices);
+        }
+        geometryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - geometryStart).count();
+
+        culler.build(scene);
+        if (scene.electronCount() <= MAX_ORBITS) scene.buildOrbits(orbitRenderer);
+        if (playback) orbitRenderer.assign(trajectory.orbits(), trajectory.orbitCount());
+        else if (printStats && scene.electronCount() > MAX_ORBITS)
+            std::cout << "Orbitas omitidas (" << scene.electronCount() << " eletrons)\n";
+        return true;
+    };
+
+    std::atomic<bool> sceneBuilt{ false };
+    bool sceneOk = false;
+    std::thread sceneThread([&] {
+        sceneOk = buildScene();
+        sceneBuilt.store(true, std::memory_order_release);
+    });
+    // Quadros de carregamento: só o fundo, com a janela respondendo, até a cena e os shaders ficarem prontos
+    if (!headless && !electronBenchmark) {
+        glfwSetWindowTitle(window, "Átomo - carregando");
+        if (orbitals.empty()) glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        else glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        while (!glfwWindowShouldClose(window) && !(sceneBuilt.load(std::memory_order_acquire) && programCache.idle())) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glfwSwapBuffers(window);
+            if (startup.firstFrame == 0.0) startup.firstFrame = millisecondsSinceStart();
+            glfwWaitEventsTimeout(1.0 / 60.0);
+            applyPendingInput();
+        }
+        glfwSetWindowTitle(window, "Átomo");
+    }
+    sceneThread.join();
+    if (!sceneOk) {
+        std::cerr << sceneErrors.str();
+        glfwTerminate();
+        return -1;
+    }
+    if (!programCache.finishAll()) {
+        glfwTerminate();
+        return -1;
+    }
+
+    maxCameraDistance = std::max(20.0f, 3.0f * sceneRadius);
+    cameraDistance = std::max(cameraDistance, 1.2f * sceneRadius / std::sin(glm::radians(22.5f)));
+    const float framingDistance = cameraDistance; // unidade de distância das trilhas de câmera
+    float farPlane = std::max(100.0f, 2.0f * (maxCameraDistance + sceneRadius));
+
+    const MeshHandle& sphereMesh = lodMeshes[0];
+
+    geometry.upload();
+    if (printStats) {
+        std::cout << "Geometria pronta em " << geometryMs << " ms\n";
+        geometry.printStats(std::cout);
+    }
+
+    ShaderProgram shaderProgram = loadShaderProgram(vertexShaderSource, fragmentShaderSource);
+    ShaderProgram instancedShaderProgram = loadShaderProgram(instancedVertexShaderSource, fragmentShaderSource);
+
+    // Uniform buffer com câmera e luz, compartilhado pelos dois programas
+    unsigned int frameUBO;
+    glGenBuffers(1, &frameUBO);
+
+    // Buffer de instâncias dos elétrons, ligado ao mesmo VAO da esfera
+    unsigned int electronInstanceVBO;
+    glGenBuffers(1, &electronInstanceVBO);
+    setupElectronInstancing(geometry.vao, electronInstanceVBO);
+
+    if (electronBenchmark) {
+        glfwSwapInterval(0);
+        int result = runElectronBenchmark(window, shaderProgram, instancedShaderProgram, frameUBO,
+                                          geometry.vao, electronInstanceVBO, sphereMesh);
+        glfwTerminate();
+        return result;
+    }
+
+    orbitRenderer.init();
+
+    RenderQueue renderQueue;
+    RenderStats statsSum;
+    unsigned int statsFrames = 0;
+    double statsStart = glfwGetTime();
+
+    // Culling pela BVH dos átomos; cada nível de detalhe tem seu VAO, com as instâncias num trecho do anel
+    unsigned int lodVAOs[LOD_LEVELS] = { geometry.vao };
+    for (unsigned int lod = 1; lod < lodLevels; ++lod) lodVAOs[lod] = geometry.createVertexArray();
+    // Impostores: as mesmas instâncias do nível 0, num VAO sem malha
+    ShaderProgram impostorProgram = loadShaderProgram(impostorVertexShaderSource, impostorFragmentShaderSource);
+    unsigned int impostorVAO;
+    glGenVertexArrays(1, &impostorVAO);
+    MeshHandle impostorQuad;
+    impostorQuad.mode = GL_TRIANGLE_STRIP;
+    impostorQuad.count = 4;
+    const float pixelsPerUnit = viewportHeight / (2.0f * std::tan(glm::radians(22.5f)));
+    CullStats cullSum;
+
+    // Uniforms e instâncias do frame vão direto para o anel mapeado; ele começa do tamanho da cena inteira
+    // (até 16 MB) e cresce se um frame precisar de mais
+    StreamBuffer stream;
+    size_t sceneInstanceBytes = (scene.atomCount() + scene.electronCount()) * sizeof(ElectronInstance);
+    if (playback) sceneInstanceBytes = trajectory.frameBytes();
+    StreamMode usedStreamMode = stream.init(streamMode, sizeof(FrameUniforms) + std::min<size_t>(sceneInstanceBytes, 16 << 20));
+    if (usedStreamMode != streamMode)
+        std::cerr << "GL_ARB_buffer_storage indisponivel, usando upload por " << streamModeName(usedStreamMode) << std::endl;
+    size_t uploadBytesSum = 0;
+
+    CloudRenderer cloudRenderer;
+    if (!orbitals.empty()) {
+        cloudRenderer.init();
+        cloudRenderer.upload(firstCloud->points);
+    }
+    double fenceWaitSum = 0.0;
+
+    TrajectoryRenderer trajectoryRenderer;
+    if (playback) trajectoryRenderer.init(trajectory, geometry);
+    size_t playbackFrame = 0;
+    float playbackClock = playback ? trajectory.frameTime(0) : 0.0f;
+
+    // Simulação em passos fixos: com janela, o tempo real se acumula e é consumido em passos de SIMULATION_STEP,
+    // e o quadro mostra a cena entre os dois últimos passos, na fração de passo que sobrou. Sem janela cada
+    // quadro é um passo de 1 / --fps e o relógio é o número do quadro, para o vídeo não depender da velocidade
+    // do render. Três buffers de instâncias: o passo anterior e o atual, que o quadro desenha, e o próximo,
+    // que as outras threads calculam enquanto a thread de render desenha.
+    JobSystem::Group stepGroup;
+    SceneStep sceneStep;
+    std::vector<ElectronInstance> instanceBuffers[3];
+    int previousBuffer = 0, currentBuffer = 0, nextBuffer = 1;
+    float lastTime = headless ? 0.0f : (float)glfwGetTime();
+    launchSceneStep(jobs, stepGroup, sceneStep, scene, lastTime, instanceBuffers[currentBuffer]);
+    jobs.wait(stepGroup);
+    scene.swapState();
+    const float simulationStep = headless ? 1.0f / fps : SIMULATION_STEP;
+    float simulationTime = lastTime, previousSimulationTime = lastTime, accumulator = 0.0f;
+    bool stepInFlight = false;
+
+    // O primeiro frame dá o raio e a cor de cada instância; o cubo da quantização é a esfera da cena
+    TrajectoryWriter trajectoryWriter;
+    if (!trajectoryRecordPath.empty() &&
+        !trajectoryWriter.open(trajectoryRecordPath, instanceBuffers[currentBuffer], scene.atomCount(), sceneCenter, sceneRadius,
+                               orbitRenderer.params())) {
+        std::cerr << "Nao foi possivel gravar a trajetoria em " << trajectoryRecordPath << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    FrameProfiler profiler;
+    if (profileHud || !tracePath.empty()) profiler.start(true);
+    CameraTrack recordedTrack;
+    BenchRun benchRun;
+    const unsigned int warmupFrames = std::min(BENCH_WARMUP_FRAMES, frameCount / 2);
+
+    startup.sceneReady = millisecondsSinceStart();
+    InputLatency inputLatency;
+    PendingTitle pendingTitle;
+    unsigned int frame = 0;
+    auto renderStart = std::chrono::steady_clock::now();
+    auto renderLoop = [&]() {
+        while (headless ? frame < frameCount : !glfwWindowShouldClose(window)) {
+            auto frameStart = std::chrono::steady_clock::now();
+            profiler.beginFrame();
+            profiler.stage("limpeza");
+            profiler.beginGpu("limpeza");
+            // Fundo preto para as nuvens, que se somam na tela
+            if (orbitals.empty()) glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+            else glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            profiler.endGpu();
+
+            profiler.stage("simulacao");
+            float time = headless ? frame / (float)fps : (float)glfwGetTime();
+            float stepTime = headless ? 1.0f / fps : time - lastTime;
+            lastTime = time;
+            unsigned int stepsDue = frame ? 1 : 0;
+            if (!headless) {
+                accumulator += stepTime;
+                stepsDue = (unsigned int)(accumulator / simulationStep);
+                accumulator -= stepsDue * simulationStep;
+                stepsDue = std::min(stepsDue, MAX_STEPS_PER_FRAME);
+            }
+            // O primeiro passo devido já foi calculado durante o frame anterior. Os do meio viram uma passada só
+            // (o passo só soma velocidade x dt à fase, então k passos cabem numa passada de k x dt), e o último é
+            // um passo inteiro, para o anterior e o atual continuarem a um passo de distância.
+            for (unsigned int done = 0; done < stepsDue;) {
+                unsigned int steps = done == 0 || done + 1 == stepsDue ? 1 : stepsDue - 1 - done;
+                if (!stepInFlight)
+                    launchSceneStep(jobs, stepGroup, sceneStep, scene, steps * simulationStep, instanceBuffers[nextBuffer]);
+                jobs.wait(stepGroup);
+                stepInFlight = false;
+                scene.swapState();
+                previousSimulationTime = simulationTime;
+                simulationTime += steps * simulationStep;
+                previousBuffer = currentBuffer;
+                currentBuffer = nextBuffer;
+                nextBuffer = 3 - previousBuffer - currentBuffer;
+                done += steps;
+            }
+            const float alpha = headless ? 1.0f : accumulator / simulationStep;
+            const float renderTime = headless ? time : glm::mix(previousSimulationTime, simulationTime, alpha);
+            // O próximo passo roda nas outras threads enquanto esta desenha (a principal ajuda no que faltar no wait)
+            if (!stepInFlight) {
+                launchSceneStep(jobs, stepGroup, sceneStep, scene, simulationStep, instanceBuffers[nextBuffer]);
+                stepInFlight = true;
+            }
+
+            // Quadro da trajetória: sem janela, um por frame; com janela, pelo relógio da gravação, em laço
+            if (playback && headless) {
+                playbackFrame = frame % trajectory.frameCount();
+            } else if (playback) {
+                float first = trajectory.frameTime(0), last = trajectory.frameTime(trajectory.frameCount() - 1);
+                if (playbackPaused) {
+                    long target = (long)trajectory.frameAt(playbackClock) + playbackSeek;
+                    playbackClock = trajectory.frameTime((size_t)std::min(std::max(target, 0L), (long)trajectory.frameCount() - 1));
+                } else {
+                    playbackClock += stepTime + playbackSeek;
+                    if (playbackClock > last) playbackClock = first;
+                    playbackClock = std::max(playbackClock, first);
+                }
+                playbackSeek = 0;
+                playbackFrame = trajectory.frameAt(playbackClock);
+            }
+
+            // A câmera é lida o mais tarde possível: a entrada pendente só é aplicada aqui, logo antes do culling e
+            // da submissão (sem a thread de eventos, os eventos também só são buscados aqui)
+            profiler.stage("eventos");
+            if (!eventThread) glfwPollEvents();
+            inputLatency.sampled(applyPendingInput());
+            if (!orbitals.empty() && orbitalSelection % orbitals.size() != shownOrbital) {
+                shownOrbital = orbitalSelection % orbitals.size();
+                const OrbitalCloudCache::Cloud& cloud = cloudCache.get(orbitals[shownOrbital], jobs);
+                reportOrbitalCloud(std::cerr, cloudCache, cloud, threadCount);
+                cloudRenderer.upload(cloud.points);
+            }
+            profiler.stage("camera");
+            if (!cameraTrack.empty()) {
+                CameraKey key = cameraTrack.sample(time);
+                yaw = key.yaw;
+                pitch = key.pitch;
+                cameraDistance = key.distance * framingDistance;
+            }
+            if (!cameraRecordPath.empty()) recordedTrack.record({ time, yaw, pitch, cameraDistance / framingDistance });
+
+            glm::vec3 cameraTarget = sceneCenter;
+            glm::vec3 cameraPos;
+            cameraPos.x = cameraTarget.x + cameraDistance * cos(glm::radians(pitch)) * cos(glm::radians(yaw));
+            cameraPos.y = cameraTarget.y + cameraDistance * sin(glm::radians(pitch));
+            cameraPos.z = cameraTarget.z + cameraDistance * cos(glm::radians(pitch)) * sin(glm::radians(yaw));
+
+            glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(viewportWidth) / viewportHeight, 0.1f, farPlane);
+
+            // Núcleos e elétrons dos átomos visíveis: uma chamada instanciada por nível de detalhe
+            // (os impostores têm a mesma qualidade em qualquer tamanho, então usam uma lista só)
+            profiler.stage("atualizacao");
+            unsigned int drawLevels = sphereImpostors ? 1 : lodLevels;
+            culler.update(scene, projection * view, cameraPos, pixelsPerUnit, drawLevels);
+            size_t lodCounts[LOD_LEVELS] = {}, instanceTotal = 0;
+            for (unsigned int lod = 0; lod < drawLevels; ++lod)
+                instanceTotal += lodCounts[lod] = countAtomInstances(scene, culler.atomsAtLod(lod));
+            size_t playbackBytes = playback ? trajectory.frameBytes() : 0;
+            stream.beginFrame(sizeof(FrameUniforms) + instanceTotal * sizeof(ElectronInstance) + playbackBytes);
+            streamFrameUniforms(stream, view, projection, cameraPos, playback ? trajectory.frameTime(playbackFrame) : renderTime);
+            for (unsigned int lod = 0; lod < drawLevels; ++lod) {
+                if (!lodCounts[lod]) continue;
+                StreamBuffer::Allocation instances = stream.allocate(lodCounts[lod] * sizeof(ElectronInstance), 16);
+                if (previousBuffer == currentBuffer || alpha >= 1.0f)
+                    gatherAtomInstances(scene, instanceBuffers[currentBuffer], culler.atomsAtLod(lod), (ElectronInstance*)instances.data);
+                else
+                    gatherInterpolatedInstances(scene, instanceBuffers[previousBuffer], instanceBuffers[currentBuffer], alpha,
+                                                culler.atomsAtLod(lod), (ElectronInstance*)instances.data);
+                unsigned int vao = sphereImpostors ? impostorVAO : lodVAOs[lod];
+                setupElectronInstancing(vao, stream.buffer(), instances.offset);
+                if (sphereImpostors)
+                    renderQueue.drawInstanced(impostorProgram, vao, impostorQuad, (GLsizei)lodCounts[lod]);
+                else
+                    renderQueue.drawInstanced(instancedShaderProgram, vao, lodMeshes[lod], (GLsizei)lodCounts[lod]);
+            }
+            if (playback)
+                trajectoryRenderer.queue(renderQueue, stream, trajectory.frame(playbackFrame), sphereImpostors, sphereMesh);
+            stream.flush();
+
+            // Órbitas: todas numa única chamada, com os pontos calculados no vertex shader
+            orbitRenderer.queue(renderQueue);
+
+            profiler.stage("submissao");
+            profiler.beginGpu("cena");
+            renderQueue.submit();
+            cloudRenderer.draw(pixelsPerUnit);
+            profiler.endGpu();
+            stream.endFrame();
+
+            // O passo em andamento escreve no terceiro buffer: a quantização do atual roda junto com ele
+            if (trajectoryWriter.isOpen()) {
+                profiler.stage("gravacao");
+                trajectoryWriter.addFrame(instanceBuffers[currentBuffer], headless ? time : simulationTime);
+            }
+
+            // Contadores do frame: média por frame no título da janela (e no terminal com --estatisticas)
+            statsSum.drawCalls += renderQueue.stats.drawCalls;
+            statsSum.programBinds += renderQueue.stats.programBinds;
+            statsSum.vaoBinds += renderQueue.stats.vaoBinds;
+            statsSum.uniformUploads += renderQueue.stats.uniformUploads;
+            statsSum.triangles += renderQueue.stats.triangles;
+            uploadBytesSum += stream.bytesThisFrame;
+            fenceWaitSum += stream.waitMilliseconds;
+            cullSum.visible += culler.stats.visible;
+            cullSum.culled += culler.stats.culled;
+            cullSum.milliseconds += culler.stats.milliseconds;
+            ++statsFrames;
+            if (glfwGetTime() - statsStart >= 1.0) {
+                char stats[400];
+                std::snprintf(stats, sizeof(stats), "%u draw calls, %u trocas de estado (%u programas, %u VAOs, %u uniforms) por frame, "
+                              "%u atomos visiveis, %u cortados, culling %.3f ms, %llu triangulos (%s), "
+                              "upload %.1f KB (%s), espera por cercas %.3f ms",
+                              statsSum.drawCalls / statsFrames, statsSum.stateChanges() / statsFrames,
+                              statsSum.programBinds / statsFrames, statsSum.vaoBinds / statsFrames, statsSum.uniformUploads / statsFrames,
+                              cullSum.visible / statsFrames, cullSum.culled / statsFrames, cullSum.milliseconds / statsFrames,
+                              (unsigned long long)(statsSum.triangles / statsFrames), sphereImpostors ? "impostores" : "malhas",
+                              uploadBytesSum / 1024.0 / statsFrames, streamModeName(usedStreamMode), fenceWaitSum / statsFrames);
+                std::string title = std::string("Átomo - ") + stats;
+                if (profileHud) {
+                    title += " | " + profiler.frameSummary();
+                    profiler.report(std::cerr);
+                }
+                pendingTitle.set(title);
+                if (eventThread) glfwPostEmptyEvent();
+                else pendingTitle.apply(window);
+                if (printStats) std::cout << stats << std::endl;
+                statsSum = RenderStats();
+                cullSum = CullStats();
+                uploadBytesSum = 0;
+                fenceWaitSum = 0.0;
+                statsFrames = 0;
+                statsStart = glfwGetTime();
+            }
+
+            profiler.stage("troca");
+            if (headless) {
+                profiler.beginGpu("leitura");
+                offscreen.readback(writing ? &writer : nullptr);
+                profiler.endGpu();
+            } else {
+                glfwSwapBuffers(window);
+                inputLatency.presented();
+            }
+            profiler.endFrame();
+            if (frame == 0) {
+                startup.firstSceneFrame = millisecondsSinceStart();
+                if (startup.firstFrame == 0.0) startup.firstFrame = startup.firstSceneFrame;
+                if (printStats || profileHud || headless) {
+                    startup.report(std::cerr);
+                    programCache.report(std::cerr);
+                }
+            }
+            if (frame >= warmupFrames) {
+                benchRun.frameMs.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+                benchRun.drawCalls += renderQueue.stats.drawCalls;
+                benchRun.triangles += renderQueue.stats.triangles;
+                benchRun.uploadBytes += stream.bytesThisFrame;
+                benchRun.fenceWaitMs += stream.waitMilliseconds;
+            }
+            ++frame;
+        }
+        if (stepInFlight) jobs.wait(stepGroup);
+    };
+
+    // Com janela, o laço acima roda numa thread de render, dona do contexto, e a thread principal só
+    // trata os eventos do GLFW (que só podem ser tratados nela): enquanto um frame pesado está sendo
+    // montado, os eventos continuam chegando, com o instante certo, na fila lida logo antes da câmera
+    if (eventThread) {
+        glfwMakeContextCurrent(nullptr);
+        std::atomic<bool> rendering{ true };
+        std::thread renderThread([&] {
+            glfwMakeContextCurrent(window);
+            renderLoop();
+            glfwMakeContextCurrent(nullptr);
+            rendering.store(false);
+            glfwPostEmptyEvent();
+        });
+        while (rendering.load()) {
+            glfwWaitEvents();
+            pendingTitle.apply(window);
+        }
+        renderThread.join();
+        glfwMakeContextCurrent(window);
+    } else {
+        renderLoop();
+    }
+
+    int result = 0;
+    if (headless) {
+        offscreen.finish(writing ? &writer : nullptr);
+        if (writing && !writer.close()) {
+            std::cerr << "Erro ao gravar " << outputPath << std::endl;
+            result = 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+        char report[256];
+        int length = std::snprintf(report, sizeof(report), "%u quadros de %ux%u em %.2f s: %.2f quadros/s (espera na leitura %.2f s",
+                                   frameCount, viewportWidth, viewportHeight, seconds, frameCount / seconds, offscreen.mapSeconds);
+        if (writing)
+            std::snprintf(report + length, sizeof(report) - length, ", gravacao %.2f s na thread de escrita", writer.writeSeconds);
+        std::cerr << report << ")" << std::endl;
+    }
+    if (profileHud) profiler.report(std::cerr);
+    if (printStats || profileHud) inputLatency.report(std::cerr, eventThread ? "thread de eventos + thread de render" : "thread unica");
+    if (!orbitals.empty()) cloudCache.report(std::cerr, threadCount);
+    if (trajectoryWriter.isOpen()) {
+        if (!trajectoryWriter.close()) {
+            std::cerr << "Erro ao gravar a trajetoria em " << trajectoryRecordPath << std::endl;
+            result = 1;
+        }
+        trajectoryWriter.report(std::cerr);
+    }
+    if (playback) trajectory.report(std::cerr);
+    if (!jsonPath.empty()) {
+        if (playback) benchRun.scene = "trajetoria " + trajectoryPath;
+        else if (latticeSize) benchRun.scene = "rede " + std::to_string(latticeSize);
+        else if (!elementName.empty()) benchRun.scene = "elemento " + elementName;
+        else if (!moleculeName.empty()) benchRun.scene = "molecula " + moleculeName;
+        else if (!xyzPath.empty()) benchRun.scene = "xyz " + xyzPath;
+        else benchRun.scene = "atomo classico";
+        benchRun.sphere = sphereImpostors ? "impostor" : useIcosphere ? "icosfera"
+                        : sphereResolution ? std::to_string(sphereResolution) + "x" + std::to_string(sphereResolution) : "lod";
+        benchRun.camera = cameraPath.empty() ? "fixa" : cameraPath;
+        // Na reprodução a cena ao vivo fica vazia: as contagens vêm do cabeçalho da trajetória
+        benchRun.atoms = playback ? trajectory.atomCount() : scene.atomCount();
+        benchRun.electrons = playback ? trajectory.instanceCount() - trajectory.atomCount() : scene.electronCount();
+        benchRun.width = viewportWidth;
+        benchRun.height = viewportHeight;
+        benchRun.frames = frame;
+        benchRun.fps = fps;
+        benchRun.threads = threadCount;
+        benchRun.upload = streamModeName(usedStreamMode);
+        benchRun.checksums = offscreen.checksums;
+        benchRun.firstFrameMs = startup.firstSceneFrame;
+        benchRun.shadersFromDisk = programCache.fromDisk;
+        benchRun.shadersCompiled = programCache.compiled;
+        std::ofstream jsonFile;
+        if (jsonPath != "-") jsonFile.open(jsonPath);
+        std::ostream& out = jsonPath == "-" ? std::cout : jsonFile;
+        benchRun.writeJson(out);
+        out << std::endl;
+        if (!out) {
+            std::cerr << "Erro ao gravar " << jsonPath << std::endl;
+            result = 1;
+        }
+    }
+    if (!cameraRecordPath.empty()) {
+        std::ofstream cameraFile(cameraRecordPath);
+        if (!recordedTrack.save(cameraFile)) {
+            std::cerr << "Erro ao gravar a trilha de camera em " << cameraRecordPath << std::endl;
+            result = 1;
+        }
+    }
+    if (!tracePath.empty() && !profiler.writeTrace(tracePath)) {
+        std::cerr << "Erro ao gravar o trace em " << tracePath << std::endl;
+        result = 1;
     }
 
     glfwTerminate();
-    return 0;
+    return result;
 }
 